@@ -1,8 +1,13 @@
 /**
  * Project 1
  * Assembler code fragment for LC-2K
+ *
+ * Usage: assembler <assembly-code-file> <machine-code-file> [<symbol-file>]
+ * The optional symbol file lists each label and its address, one per line,
+ * for the simulator's -s option.
  */
 
+#include <limits.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -11,37 +16,90 @@
 
 //Every LC2K file will contain less than 1000 lines of assembly.
 #define MAXLINELENGTH 1000
-#define MAXLABELS 1000
+
+// Label hash table: open addressing, at most half full, doubled as it fills
+#define MINLABELTABLESIZE 2048
+
+// Label names are packed end to end in blocks of this size
+#define NAMEBLOCKSIZE 65536
+
+// Opcode numbers, and the .fill directive
+#define ADD 0
+#define NOR 1
+#define LW 2
+#define SW 3
+#define BEQ 4
+#define JALR 5
+#define HALT 6
+#define NOOP 7
+#define FILL 8
 
 // Structure to store label information
 typedef struct {
-    char name[MAXLINELENGTH];
+    char *name;
     int address;
 } Label;
 
-int readAndParse(FILE *, char *, char *, char *, char *, char *);
-static void checkForBlankLinesInCode(FILE *inFilePtr);
-static inline int isNumber(char *);
-static inline void printHexToFile(FILE *, int);
+// An argument field, and its value when it is an integer
+typedef struct {
+    char *text;
+    bool isNumber;
+    int value;
+} Field;
+
+// One line of assembly split into its fields
+typedef struct {
+    char *label, *opcode;
+    Field arg[3];
+} Line;
 
-// Global arrays for labels
-Label labels[MAXLABELS];
+int readAndParse(Line *);
+static void checkForBlankLinesInCode(void);
+static inline bool parseNumber(char *, int *);
+static inline void printHexToFile(int);
+
+// Global arrays for labels, grown as needed
+Label *labels;
 int labelCount = 0;
+static int labelCapacity = 0;
+
+// Index + 1 of the label hashing to each slot, or 0 when the slot is empty
+static int *labelTable;
+static int labelTableSize = 0;
+
+// The block label names are currently copied into, and how much of it is used
+static char *nameBlock;
+static size_t nameBlockUsed = NAMEBLOCKSIZE;
+
+// The machine code file, and its text until it is written out
+static FILE *outFilePtr;
+static char *outBuffer;
+static size_t outLength = 0;
+
+// The whole assembly file, read once, and the offset of its next unread line
+static char *source;
+static size_t sourceSize, sourcePos;
+
+// Parsed lines, up to the first blank line at the end of the file
+static Line *lines;
+static int lineCount = 0;
 
 // Function prototypes
 int findLabel(char *labelName);
 void addLabel(char *labelName, int address);
 int getOpcode(char *opcode);
-int assembleLine(char *label, char *opcode, char *arg0, char *arg1, char *arg2, int address);
+int assembleLine(Line *line, int address);
+void writeSymbols(char *symbolFileString);
+static void readSource(FILE *inFilePtr);
+static void tokenizeSource(void);
+static void writeOutput(void);
 
 int main(int argc, char **argv)
 {
     char *inFileString, *outFileString;
-    FILE *inFilePtr, *outFilePtr;
-    char label[MAXLINELENGTH], opcode[MAXLINELENGTH], arg0[MAXLINELENGTH],
-            arg1[MAXLINELENGTH], arg2[MAXLINELENGTH];
+    FILE *inFilePtr;
 
-    if (argc != 3) {
+    if (argc != 3 && argc != 4) {
         printf("error: usage: %s <assembly-code-file> <machine-code-file>\n",
             argv[0]);
         exit(1);
@@ -56,8 +114,11 @@ int main(int argc, char **argv)
         exit(1);
     }
 
+    readSource(inFilePtr);
+    fclose(inFilePtr);
+
     // Check for blank lines in the middle of the code.
-    checkForBlankLinesInCode(inFilePtr);
+    checkForBlankLinesInCode();
 
     outFilePtr = fopen(outFileString, "w");
     if (outFilePtr == NULL) {
@@ -65,10 +126,21 @@ int main(int argc, char **argv)
         exit(1);
     }
 
+    tokenizeSource();
+
+    // Every word prints as 11 characters, so the whole file fits in one
+    // buffer and goes out in a single write (or at exit, after an error)
+    outBuffer = malloc((size_t)lineCount * 11 + 1);
+    if (outBuffer == NULL) {
+        printf("error: out of memory\n");
+        exit(1);
+    }
+    atexit(writeOutput);
+
     // First pass: collect all labels
-    rewind(inFilePtr);
-    int address = 0;
-    while(readAndParse(inFilePtr, label, opcode, arg0, arg1, arg2)) {
+    for (int address = 0; address < lineCount; address++) {
+        char *label = lines[address].label;
+        char *opcode = lines[address].opcode;
         // If there's a label, add it to our label table
         if (strlen(label) > 0) {
             // Check if label already exists
@@ -90,80 +162,225 @@ int main(int argc, char **argv)
         }
         
         // Check for valid opcode
-        if (strcmp(opcode, "add") && strcmp(opcode, "nor") && strcmp(opcode, "lw") && 
-            strcmp(opcode, "sw") && strcmp(opcode, "beq") && strcmp(opcode, "jalr") && 
-            strcmp(opcode, "halt") && strcmp(opcode, "noop") && strcmp(opcode, ".fill")) {
+        if (getOpcode(opcode) == -1) {
             printf("error: unrecognized opcode %s\n", opcode);
             exit(1);
         }
-        
-        address++;
     }
 
     // Second pass: generate machine code
-    rewind(inFilePtr);
-    address = 0;
-    while(readAndParse(inFilePtr, label, opcode, arg0, arg1, arg2)) {
-        int machineCode = assembleLine(label, opcode, arg0, arg1, arg2, address);
-        printHexToFile(outFilePtr, machineCode);
-        address++;
+    for (int address = 0; address < lineCount; address++) {
+        int machineCode = assembleLine(&lines[address], address);
+        printHexToFile(machineCode);
     }
 
-    fclose(inFilePtr);
-    fclose(outFilePtr);
+    writeOutput();
+    if (argc == 4) {
+        writeSymbols(argv[3]);
+    }
     exit(0);
 }
 
+// Read the whole assembly file into source
+static void readSource(FILE *inFilePtr) {
+    size_t capacity = 1 << 16;
+    source = malloc(capacity);
+    for (;;) {
+        if (source == NULL) {
+            printf("error: out of memory\n");
+            exit(1);
+        }
+        sourceSize += fread(source + sourceSize, 1, capacity - sourceSize, inFilePtr);
+        if (sourceSize < capacity) {
+            break;
+        }
+        capacity *= 2;
+        source = realloc(source, capacity);
+    }
+    // The lexer relies on a terminator after the last line
+    source[sourceSize] = '\0';
+}
+
+// Copy the next line of source into line exactly as fgets would.
+// Returns 0 once the whole file has been read.
+static int nextSourceLine(char *line) {
+    if (sourcePos >= sourceSize) {
+        return 0;
+    }
+    size_t length = sourceSize - sourcePos;
+    if (length > MAXLINELENGTH - 1) {
+        length = MAXLINELENGTH - 1;
+    }
+    char *newline = memchr(source + sourcePos, '\n', length);
+    if (newline != NULL) {
+        length = (size_t)(newline - (source + sourcePos)) + 1;
+    }
+    memcpy(line, source + sourcePos, length);
+    line[length] = '\0';
+    sourcePos += length;
+    return 1;
+}
+
+// Parse every line of source once into lines
+static void tokenizeSource(void) {
+    int capacity = 0;
+
+    sourcePos = 0;
+    for (;;) {
+        if (lineCount == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            lines = realloc(lines, (size_t)capacity * sizeof(Line));
+            if (lines == NULL) {
+                printf("error: out of memory\n");
+                exit(1);
+            }
+        }
+        if (!readAndParse(&lines[lineCount])) {
+            break;
+        }
+        lineCount++;
+    }
+}
+
+// Write the buffered machine code and close the output file.  Also run at
+// exit, so an error in the second pass leaves the words assembled before it.
+static void writeOutput(void) {
+    if (outFilePtr != NULL) {
+        fwrite(outBuffer, 1, outLength, outFilePtr);
+        fclose(outFilePtr);
+        outFilePtr = NULL;
+    }
+}
+
+// FNV-1a hash of a label name
+static unsigned int hashLabel(char *labelName) {
+    unsigned int hash = 2166136261u;
+    for (; *labelName; labelName++) {
+        hash = (hash ^ (unsigned char)*labelName) * 16777619u;
+    }
+    return hash;
+}
+
+// Slot holding labelName in labelTable, or the empty slot where it would go
+static int findLabelSlot(char *labelName) {
+    int slot = (int)(hashLabel(labelName) & (unsigned int)(labelTableSize - 1));
+    while (labelTable[slot] && strcmp(labels[labelTable[slot] - 1].name, labelName)) {
+        slot = (slot + 1) & (labelTableSize - 1);
+    }
+    return slot;
+}
+
 // Find label in label table, return address or -1 if not found
 int findLabel(char *labelName) {
-    for (int i = 0; i < labelCount; i++) {
-        if (!strcmp(labels[i].name, labelName)) {
-            return labels[i].address;
+    if (labelTableSize == 0) {
+        return -1;
+    }
+    int slot = findLabelSlot(labelName);
+    return labelTable[slot] ? labels[labelTable[slot] - 1].address : -1;
+}
+
+// Copy a label name into the current name block
+static char *internName(char *labelName) {
+    size_t size = strlen(labelName) + 1;
+    if (size > NAMEBLOCKSIZE - nameBlockUsed) {
+        nameBlock = malloc(size > NAMEBLOCKSIZE ? size : NAMEBLOCKSIZE);
+        if (nameBlock == NULL) {
+            printf("error: out of memory\n");
+            exit(1);
         }
+        nameBlockUsed = 0;
+    }
+    char *name = memcpy(nameBlock + nameBlockUsed, labelName, size);
+    nameBlockUsed += size;
+    return name;
+}
+
+// Double the hash table (or create it) and rehash every label into it
+static void growLabelTable(void) {
+    free(labelTable);
+    labelTableSize = labelTableSize ? labelTableSize * 2 : MINLABELTABLESIZE;
+    labelTable = calloc((size_t)labelTableSize, sizeof(int));
+    if (labelTable == NULL) {
+        printf("error: out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < labelCount; i++) {
+        labelTable[findLabelSlot(labels[i].name)] = i + 1;
     }
-    return -1;
 }
 
 // Add label to label table
 void addLabel(char *labelName, int address) {
-    if (labelCount >= MAXLABELS) {
-        printf("error: too many labels\n");
-        exit(1);
+    if (labelCount == labelCapacity) {
+        labelCapacity = labelCapacity ? labelCapacity * 2 : 1024;
+        labels = realloc(labels, (size_t)labelCapacity * sizeof(Label));
+        if (labels == NULL) {
+            printf("error: out of memory\n");
+            exit(1);
+        }
     }
-    strcpy(labels[labelCount].name, labelName);
+    labels[labelCount].name = internName(labelName);
     labels[labelCount].address = address;
     labelCount++;
+    if (labelCount * 2 > labelTableSize) {
+        growLabelTable();
+    } else {
+        labelTable[findLabelSlot(labelName)] = labelCount;
+    }
 }
 
-// Get opcode number
+// Write every label and its address, one per line
+void writeSymbols(char *symbolFileString) {
+    FILE *symbolFilePtr = fopen(symbolFileString, "w");
+    if (symbolFilePtr == NULL) {
+        printf("error in opening %s\n", symbolFileString);
+        exit(1);
+    }
+    for (int i = 0; i < labelCount; i++) {
+        fprintf(symbolFilePtr, "%s %d\n", labels[i].name, labels[i].address);
+    }
+    fclose(symbolFilePtr);
+}
+
+// Mnemonics by slot: the sum of the first three characters (fewer for
+// shorter names) mod 16 is different for each of the nine
+static const struct {
+    const char *name;
+    int opcode;
+} mnemonics[16] = {
+    [3] = {"lw", LW}, [5] = {"halt", HALT}, [7] = {"jalr", JALR},
+    [8] = {"beq", BEQ}, [9] = {"add", ADD}, [10] = {"sw", SW},
+    [12] = {"noop", NOOP}, [13] = {".fill", FILL}, [15] = {"nor", NOR},
+};
+
+// Get opcode number, FILL for .fill, or -1 if the mnemonic is unknown
 int getOpcode(char *opcode) {
-    if (!strcmp(opcode, "add")) return 0;
-    if (!strcmp(opcode, "nor")) return 1;
-    if (!strcmp(opcode, "lw")) return 2;
-    if (!strcmp(opcode, "sw")) return 3;
-    if (!strcmp(opcode, "beq")) return 4;
-    if (!strcmp(opcode, "jalr")) return 5;
-    if (!strcmp(opcode, "halt")) return 6;
-    if (!strcmp(opcode, "noop")) return 7;
-    return -1;
+    unsigned int sum = 0;
+    for (int i = 0; i < 3 && opcode[i]; i++) {
+        sum += (unsigned char)opcode[i];
+    }
+    int slot = (int)(sum & 15);
+    if (mnemonics[slot].name == NULL || strcmp(mnemonics[slot].name, opcode)) {
+        return -1;
+    }
+    return mnemonics[slot].opcode;
 }
 
 // Assemble a single line
-int assembleLine(char *label, char *opcode, char *arg0, char *arg1, char *arg2, int address) {
+int assembleLine(Line *line, int address) {
+    Field *arg = line->arg;
     int machineCode = 0;
-    int opcodeNum = getOpcode(opcode);
+    int opcodeNum = getOpcode(line->opcode);
     
     // Handle .fill directive
-    if (!strcmp(opcode, ".fill")) {
-        if (isNumber(arg0)) {
-            int num;
-            sscanf(arg0, "%d", &num);
-            return num;
+    if (opcodeNum == FILL) {
+        if (arg[0].isNumber) {
+            return arg[0].value;
         } else {
             // Symbolic address for .fill
-            int labelAddr = findLabel(arg0);
+            int labelAddr = findLabel(arg[0].text);
             if (labelAddr == -1) {
-                printf("error: undefined label %s\n", arg0);
+                printf("error: undefined label %s\n", arg[0].text);
                 exit(1);
             }
             return labelAddr;
@@ -174,18 +391,18 @@ int assembleLine(char *label, char *opcode, char *arg0, char *arg1, char *arg2,
     machineCode |= (opcodeNum << 22);
     
     // Handle different instruction types
-    if (!strcmp(opcode, "add") || !strcmp(opcode, "nor")) {
+    if (opcodeNum == ADD || opcodeNum == NOR) {
         // R-type instruction
         int regA, regB, destReg;
         
-        if (!isNumber(arg0) || !isNumber(arg1) || !isNumber(arg2)) {
+        if (!arg[0].isNumber || !arg[1].isNumber || !arg[2].isNumber) {
             printf("error: non-integer register arguments\n");
             exit(1);
         }
         
-        sscanf(arg0, "%d", &regA);
-        sscanf(arg1, "%d", &regB);
-        sscanf(arg2, "%d", &destReg);
+        regA = arg[0].value;
+        regB = arg[1].value;
+        destReg = arg[2].value;
         
         if (regA < 0 || regA > 7 || regB < 0 || regB > 7 || destReg < 0 || destReg > 7) {
             printf("error: registers outside range [0, 7]\n");
@@ -196,17 +413,17 @@ int assembleLine(char *label, char *opcode, char *arg0, char *arg1, char *arg2,
         machineCode |= (regB << 16);
         machineCode |= destReg;
         
-    } else if (!strcmp(opcode, "lw") || !strcmp(opcode, "sw") || !strcmp(opcode, "beq")) {
+    } else if (opcodeNum == LW || opcodeNum == SW || opcodeNum == BEQ) {
         // I-type instruction
         int regA, regB, offset;
         
-        if (!isNumber(arg0) || !isNumber(arg1)) {
+        if (!arg[0].isNumber || !arg[1].isNumber) {
             printf("error: non-integer register arguments\n");
             exit(1);
         }
         
-        sscanf(arg0, "%d", &regA);
-        sscanf(arg1, "%d", &regB);
+        regA = arg[0].value;
+        regB = arg[1].value;
         
         if (regA < 0 || regA > 7 || regB < 0 || regB > 7) {
             printf("error: registers outside range [0, 7]\n");
@@ -214,17 +431,17 @@ int assembleLine(char *label, char *opcode, char *arg0, char *arg1, char *arg2,
         }
         
         // Handle offset field
-        if (isNumber(arg2)) {
-            sscanf(arg2, "%d", &offset);
+        if (arg[2].isNumber) {
+            offset = arg[2].value;
         } else {
             // Symbolic address
-            int labelAddr = findLabel(arg2);
+            int labelAddr = findLabel(arg[2].text);
             if (labelAddr == -1) {
-                printf("error: undefined label %s\n", arg2);
+                printf("error: undefined label %s\n", arg[2].text);
                 exit(1);
             }
             
-            if (!strcmp(opcode, "beq")) {
+            if (opcodeNum == BEQ) {
                 // For beq, offset is relative to PC+1
                 offset = labelAddr - (address + 1);
             } else {
@@ -249,17 +466,17 @@ int assembleLine(char *label, char *opcode, char *arg0, char *arg1, char *arg2,
         // }
         machineCode |= (offset & 0xFFFF);  // Mask to 16 bits
         
-    } else if (!strcmp(opcode, "jalr")) {
+    } else if (opcodeNum == JALR) {
         // J-type instruction
         int regA, regB;
         
-        if (!isNumber(arg0) || !isNumber(arg1)) {
+        if (!arg[0].isNumber || !arg[1].isNumber) {
             printf("error: non-integer register arguments\n");
             exit(1);
         }
         
-        sscanf(arg0, "%d", &regA);
-        sscanf(arg1, "%d", &regB);
+        regA = arg[0].value;
+        regB = arg[1].value;
         
         if (regA < 0 || regA > 7 || regB < 0 || regB > 7) {
             printf("error: registers outside range [0, 7]\n");
@@ -269,7 +486,7 @@ int assembleLine(char *label, char *opcode, char *arg0, char *arg1, char *arg2,
         machineCode |= (regA << 19);
         machineCode |= (regB << 16);
         
-    } else if (!strcmp(opcode, "halt") || !strcmp(opcode, "noop")) {
+    } else if (opcodeNum == HALT || opcodeNum == NOOP) {
         // O-type instruction - opcode already set, nothing else needed
     }
     
@@ -297,14 +514,14 @@ static int lineIsBlank(char *line) {
 }
 
 // Exits 2 if file contains an empty line anywhere other than at the end of the file.
-// Note calling this function rewinds inFilePtr.
-static void checkForBlankLinesInCode(FILE *inFilePtr) {
+// Note calling this function rewinds the source.
+static void checkForBlankLinesInCode(void) {
     char line[MAXLINELENGTH];
     int blank_line_encountered = 0;
     int address_of_blank_line = 0;
-    rewind(inFilePtr);
+    sourcePos = 0;
 
-    for(int address = 0; fgets(line, MAXLINELENGTH, inFilePtr) != NULL; ++address) {
+    for(int address = 0; nextSourceLine(line); ++address) {
         // Check for line too long
         if (strlen(line) >= MAXLINELENGTH-1) {
             printf("error: line too long\n");
@@ -324,7 +541,7 @@ static void checkForBlankLinesInCode(FILE *inFilePtr) {
             }
         }
     }
-    rewind(inFilePtr);
+    sourcePos = 0;
 }
 
 
@@ -332,72 +549,160 @@ static void checkForBlankLinesInCode(FILE *inFilePtr) {
 * NOTE: The code defined below is not to be modifed as it is implimented correctly.
 */
 
+// Separators between fields
+static inline bool
+isFieldSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
 /*
- * Read and parse a line of the assembly-language file.  Fields are returned
- * in label, opcode, arg0, arg1, arg2 (these strings must have memory already
- * allocated to them).
+ * Split the next line of the assembly-language source into fields, in
+ * place: each field is NUL-terminated inside source, and missing fields
+ * point at an empty string.  Integer arguments are converted here, so
+ * nothing is parsed twice.
  *
  * Return values:
- *     0 if reached end of file
+ *     0 if reached end of file or a blank line
  *     1 if all went well
  *
- * exit(1) if line is too long.
+ * Lines break where fgets would have broken them.  Lines that are too long
+ * have already been rejected by checkForBlankLinesInCode.
  */
 int
-readAndParse(FILE *inFilePtr, char *label, char *opcode, char *arg0,
-    char *arg1, char *arg2)
+readAndParse(Line *line)
 {
-    char line[MAXLINELENGTH];
-    char *ptr = line;
-
-    /* delete prior values */
-    label[0] = opcode[0] = arg0[0] = arg1[0] = arg2[0] = '\0';
+    static char noField[1];
+    char *start = source + sourcePos;
+    char *fieldStart[5], *fieldEnd[5];
+    int fields;
 
-    /* read the line from the assembly-language file */
-    if (fgets(line, MAXLINELENGTH, inFilePtr) == NULL) {
-	/* reached end of file */
+    if (sourcePos >= sourceSize) {
+        /* reached end of file */
         return(0);
     }
+    size_t length = sourceSize - sourcePos;
+    if (length > MAXLINELENGTH - 1) {
+        length = MAXLINELENGTH - 1;
+    }
+    char *newline = memchr(start, '\n', length);
+    if (newline != NULL) {
+        length = (size_t)(newline - start) + 1;
+    }
+    sourcePos += length;
 
-    /* check for line too long */
-    if (strlen(line) == MAXLINELENGTH-1) {
-	printf("error: line too long\n");
-	exit(1);
+    // Like any C string, the line stops at an embedded NUL
+    char *end = memchr(start, '\0', length);
+    if (end == NULL) {
+        end = start + length;
     }
 
     // Ignore blank lines at the end of the file.
-    if(lineIsBlank(line)) {
-        return 0;
+    char *ptr = start;
+    while (ptr < end && isFieldSpace(*ptr)) {
+        ptr++;
+    }
+    if (ptr == end) {
+        return(0);
     }
 
-    /* is there a label? */
-    ptr = line;
-    if (sscanf(ptr, "%[^\t\n ]", label)) {
-	/* successfully read label; advance pointer over the label */
-        ptr += strlen(label);
+    /* the label runs up to a tab, newline or space; '\r' is part of it */
+    ptr = start;
+    while (ptr < end && *ptr != '\t' && *ptr != '\n' && *ptr != ' ') {
+        ptr++;
+    }
+    fieldStart[0] = start;
+    fieldEnd[0] = ptr;
+
+    /* then up to four separated fields: opcode, arg0, arg1, arg2 */
+    for (fields = 1; fields < 5; fields++) {
+        while (ptr < end && isFieldSpace(*ptr)) {
+            ptr++;
+        }
+        if (ptr == end) {
+            break;
+        }
+        fieldStart[fields] = ptr;
+        while (ptr < end && !isFieldSpace(*ptr)) {
+            ptr++;
+        }
+        fieldEnd[fields] = ptr;
     }
 
-    /*
-     * Parse the rest of the line.  Would be nice to have real regular
-     * expressions, but scanf will suffice.
-     */
-    sscanf(ptr, "%*[\t\n\r ]%[^\t\n\r ]%*[\t\n\r ]%[^\t\n\r ]%*[\t\n\r ]%[^\t\n\r ]%*[\t\n\r ]%[^\t\n\r ]",
-        opcode, arg0, arg1, arg2);
+    // Every field ends on a separator, the NUL, or the terminator after the
+    // last line, so it can be cut off where it stands
+    for (int i = 0; i < fields; i++) {
+        *fieldEnd[i] = '\0';
+    }
+    for (int i = fields; i < 5; i++) {
+        fieldStart[i] = noField;
+    }
 
+    line->label = fieldStart[0];
+    line->opcode = fieldStart[1];
+    for (int i = 0; i < 3; i++) {
+        line->arg[i].text = fieldStart[i + 2];
+        line->arg[i].isNumber = parseNumber(line->arg[i].text, &line->arg[i].value);
+    }
     return(1);
 }
 
-static inline int
-isNumber(char *string)
+// Parse string the way sscanf("%d%c") accepts it as a lone integer:
+// optional leading whitespace and sign, then digits to the end of the
+// string.  Out-of-range values saturate to a long and are then truncated
+// to an int, as glibc does.
+static inline bool
+parseNumber(char *string, int *value)
 {
-    int num;
-    char c;
-    return((sscanf(string, "%d%c",&num, &c)) == 1);
+    bool negative = false, overflow = false;
+    unsigned long magnitude = 0;
+    char *digits;
+
+    while (*string == ' ' || (*string >= '\t' && *string <= '\r')) {
+        string++;
+    }
+    if (*string == '+' || *string == '-') {
+        negative = *string == '-';
+        string++;
+    }
+    for (digits = string; *string >= '0' && *string <= '9'; string++) {
+        unsigned long digit = (unsigned long)(*string - '0');
+        if (magnitude > (ULONG_MAX - digit) / 10) {
+            overflow = true;
+        } else {
+            magnitude = magnitude * 10 + digit;
+        }
+    }
+    if (string == digits || *string != '\0') {
+        return false;
+    }
+
+    long number;
+    if (negative) {
+        number = (overflow || magnitude > (unsigned long)LONG_MAX + 1)
+            ? LONG_MIN : magnitude ? -(long)(magnitude - 1) - 1 : 0;
+    } else {
+        number = (overflow || magnitude > LONG_MAX) ? LONG_MAX : (long)magnitude;
+    }
+    *value = (int)number;
+    return true;
 }
 
 
-// Prints a machine code word in the proper hex format to the file
+// Appends a machine code word in the proper hex format ("0x%08X\n") to the
+// output buffer
 static inline void 
-printHexToFile(FILE *outFilePtr, int word) {
-    fprintf(outFilePtr, "0x%08X\n", word);
+printHexToFile(int word) {
+    static const char hexDigits[] = "0123456789ABCDEF";
+    unsigned int bits = (unsigned int)word;
+    char *text = outBuffer + outLength;
+
+    text[0] = '0';
+    text[1] = 'x';
+    for (int i = 9; i >= 2; i--) {
+        text[i] = hexDigits[bits & 15];
+        bits >>= 4;
+    }
+    text[10] = '\n';
+    outLength += 11;
 }
\ No newline at end of file
@@ -5,42 +5,40 @@
 #include <iostream>
 #include <string>
 #include <cstring>
+#include <cstdlib>
 #include <vector>
-#include <unordered_map>
-#include <queue>
 #include <algorithm>
-#include <cassert>
+#include <atomic>
+#include <iomanip>
+#include <list>
+#include <memory>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include "word_graph.h"
 using namespace std;
 
-// Global variables
-vector<string> dictionary;
-vector<int> original_order; // Maps sorted index back to original dictionary order
-
-// Split data structures for memory efficiency
-vector<int> parent_info;       // Always needed for path reconstruction
-
-// Modification details - only allocated for modification output
-struct ModificationInfo {
-    unsigned char modification_type;  // 0=none, 1=c, 2=i, 3=d, 4=s
-    unsigned char modification_pos;
-    char modification_char;
-    
-    ModificationInfo() : modification_type(0), modification_pos(0), modification_char(' ') {}
-};
-vector<ModificationInfo> mod_info; // Only used for modification output
-
 struct Config {
     bool use_stack = false;
     bool use_queue = false;
+    bool use_dijkstra = false;
     bool change_mode = false;
     bool length_mode = false;
     bool swap_mode = false;
     bool word_output = true;  // default to word output
+    int costs[5] = {0, 1, 1, 1, 1};  // Indexed by modification_type (c, i, d, s)
     string begin_word = "";
     string end_word = "";
     bool help_requested = false;
+    string batch_file = "";  // Query file; empty for a single query
+    unsigned threads = 0;    // Batch workers; 0 means one per core
+    bool compact = false;    // Keep the dictionary front-coded
+    bool print_stats = false; // Report lookup statistics on cerr
+    size_t cache_mb = 0;     // Parent tree cache budget for batch mode; 0 disables it
+    size_t memory_mb = 0;    // Out-of-core memory limit; 0 keeps everything in memory
 };
-Config config;
 
 void print_help() {
     cout << "Usage: letter [OPTIONS]\n"
@@ -48,462 +46,171 @@ void print_help() {
          << "Required options:\n"
          << "  -s, --stack          Use stack-based routing (depth-first search)\n"
          << "  -q, --queue          Use queue-based routing (breadth-first search)\n"
+         << "  -d, --dijkstra       Use weighted routing (lowest total modification cost)\n"
          << "  -b, --begin WORD     Starting word for transformation\n"
          << "  -e, --end WORD       Target word for transformation\n\n"
          << "Modification options (at least one required):\n"
          << "  -c, --change         Allow changing one letter to another\n"
          << "  -l, --length         Allow inserting/deleting letters\n"
          << "  -p, --swap           Allow swapping adjacent letters\n\n"
+         << "Cost options (dijkstra only, default 1 each):\n"
+         << "  --change-cost N      Cost of changing a letter\n"
+         << "  --insert-cost N      Cost of inserting a letter\n"
+         << "  --delete-cost N      Cost of deleting a letter\n"
+         << "  --swap-cost N        Cost of swapping adjacent letters\n\n"
          << "Output options:\n"
          << "  -o, --output MODE    Output format: W (word) or M (modification)\n\n"
+         << "Batch options:\n"
+         << "  --batch FILE         Solve every query in FILE, one \"BEGIN END FLAGS\" per line;\n"
+         << "                       FLAGS combines s/q/d, c/l/p and optionally W/M (e.g. qcM).\n"
+         << "                       Results are printed in input order.\n"
+         << "  --threads N          Number of batch worker threads (default: one per core)\n"
+         << "  --cache-mb N         Keep up to N MB of queue/stack search trees so later queries\n"
+         << "                       from the same begin word and flags skip the search\n\n"
+         << "Memory options:\n"
+         << "  --compact            Store the dictionary front-coded: less memory, slower lookups\n"
+         << "  --memory-mb N        Run out of core: sort the dictionary into memory-mapped\n"
+         << "                       temporary files ($TMPDIR, default /tmp), keep search state\n"
+         << "                       there too, and keep resident memory within N MB, or as\n"
+         << "                       close as the program's own few MB allow\n\n"
          << "Other options:\n"
+         << "  --stats              Report candidate lookup statistics on stderr\n"
          << "  -h, --help           Show this help message\n";
 }
 
-inline void add_word_to_dictionary(const string& word) {
-    // Just add to dictionary - we'll sort and create mappings later
-    dictionary.push_back(word);
+// Output functions
+void output_word_format(const WordGraph& graph, const QueryResult& result, bool show_cost, ostream& out) {
+    const vector<int>& path = result.path;
+    out << "Words in morph: " << path.size() << "\n";
+    if (show_cost) {
+        out << "Cost of morph: " << result.total_cost << "\n";
+    }
+    for (size_t i = 0; i < path.size(); ++i) {
+        out << graph.word(path[i]) << "\n";
+    }
 }
 
-void process_complex_word(const string& word) {
-    
-    // Check for reversal (&)
-    if (word.back() == '&') {
-        string base = word.substr(0, word.length() - 1);
-        add_word_to_dictionary(base);
-        string reversed = base;
-        reverse(reversed.begin(), reversed.end());
-        add_word_to_dictionary(reversed);
-        return;
+void output_modification_format(const WordGraph& graph, const QueryResult& result, bool show_cost, ostream& out) {
+    const vector<int>& path = result.path;
+    out << "Words in morph: " << path.size() << "\n";
+    if (show_cost) {
+        out << "Cost of morph: " << result.total_cost << "\n";
     }
+    out << graph.word(path[0]) << "\n"; // Start word
     
-    // Check for insert-each ([])
-    size_t open_bracket = word.find('[');
-    if (open_bracket != string::npos) {
-        size_t close_bracket = word.find(']');
-        string prefix = word.substr(0, open_bracket);
-        string suffix = word.substr(close_bracket + 1);
-        string chars = word.substr(open_bracket + 1, close_bracket - open_bracket - 1);
+    for (size_t i = 1; i < path.size(); ++i) {
+        const ModificationInfo& info = result.modifications[i];
         
-        for (size_t i = 0; i < chars.length(); ++i) {
-            add_word_to_dictionary(prefix + chars[i] + suffix);
+        if (info.modification_type == 1) { // 'c'
+            out << "c," << static_cast<int>(info.modification_pos) << "," << info.modification_char << "\n";
+        } else if (info.modification_type == 2) { // 'i'
+            out << "i," << static_cast<int>(info.modification_pos) << "," << info.modification_char << "\n";
+        } else if (info.modification_type == 3) { // 'd'
+            out << "d," << static_cast<int>(info.modification_pos) << "\n";
+        } else if (info.modification_type == 4) { // 's'
+            out << "s," << static_cast<int>(info.modification_pos) << "\n";
         }
-        return;
-    }
-    
-    // Check for swap (!)
-    size_t exclamation = word.find('!');
-    if (exclamation != string::npos && exclamation >= 2) {
-        string base = word.substr(0, exclamation) + word.substr(exclamation + 1);
-        add_word_to_dictionary(base);
-        
-        // Create swapped version
-        string swapped = base;
-        swap(swapped[exclamation - 2], swapped[exclamation - 1]);
-        add_word_to_dictionary(swapped);
-        return;
-    }
-    
-    // Check for double (?)
-    size_t question = word.find('?');
-    if (question != string::npos && question >= 1) {
-        string base = word.substr(0, question) + word.substr(question + 1);
-        add_word_to_dictionary(base);
-
-        // Create doubled version
-        string doubled = word.substr(0, question) + word[question - 1] + word.substr(question + 1);
-        add_word_to_dictionary(doubled);
-        return;
     }
-    
-    // No special characters, just return the word as-is
-    add_word_to_dictionary(word);
 }
 
-inline int find_word_id(const string& word) {
-    // Binary search on sorted dictionary
-    int left = 0;
-    int right = static_cast<int>(dictionary.size()) - 1;
-    
-    while (left <= right) {
-        int mid = left + (right - left) / 2;
-        if (dictionary[mid] == word) {
-            return mid;
-        } else if (dictionary[mid] < word) {
-            left = mid + 1;
+// Print a finished search the way a single query reports it
+void output_result(const WordGraph& graph, const QueryResult& result, const Config& config, ostream& out) {
+    if (result.found) {
+        // Output the path
+        if (config.word_output) {
+            output_word_format(graph, result, config.use_dijkstra, out);
         } else {
-            right = mid - 1;
+            output_modification_format(graph, result, config.use_dijkstra, out);
         }
     }
-    return -1;
+    else
+    {
+        out << "No solution, " << result.discovered_count << " words discovered.\n";
+    }
 }
 
-void prepare_dictionary_for_search() {
-    // Remove duplicates while preserving original order mapping
-    vector<pair<string, int> > word_with_order;
-    for (int i = 0; i < static_cast<int>(dictionary.size()); ++i) {
-        word_with_order.push_back(make_pair(dictionary[i], i));
-    }
-    
-    // Sort by word to remove duplicates
-    sort(word_with_order.begin(), word_with_order.end());
-    
-    // Remove duplicates
-    vector<pair<string, int> >::iterator new_end = word_with_order.begin();
-    for (vector<pair<string, int> >::iterator it = word_with_order.begin(); it != word_with_order.end(); ++it) {
-        if (new_end == word_with_order.begin() || new_end[-1].first != it->first) {
-            *new_end = *it;
-            ++new_end;
-        }
-    }
-    word_with_order.erase(new_end, word_with_order.end());
-    
-    // Rebuild dictionary and original_order mapping
-    dictionary.clear();
-    original_order.clear();
-    dictionary.reserve(word_with_order.size());
-    original_order.reserve(word_with_order.size());
-    
-    for (size_t i = 0; i < word_with_order.size(); ++i) {
-        dictionary.push_back(word_with_order[i].first);
-        original_order.push_back(word_with_order[i].second);
-    }
-    
-    // Initialize data structures based on output mode
-    int dict_size = static_cast<int>(dictionary.size());
-    parent_info.resize(dict_size, -2);  // -2 means undiscovered
-    
-    // Only allocate modification info if needed
-    if (!config.word_output) {
-        mod_info.resize(dict_size);
-    }
+// Build the engine query for the parsed command line
+Query make_query(const Config& config, int begin_word_id, int end_word_id) {
+    Query query;
+    query.routing = config.use_queue ? Routing::Queue : config.use_stack ? Routing::Stack : Routing::Dijkstra;
+    query.modes = (config.change_mode ? MODE_CHANGE : 0) |
+                  (config.length_mode ? MODE_LENGTH : 0) |
+                  (config.swap_mode ? MODE_SWAP : 0) |
+                  (config.word_output ? MODE_WORD_OUTPUT : 0);
+    query.begin_word_id = begin_word_id;
+    query.end_word_id = end_word_id;
+    copy(config.costs, config.costs + 5, query.costs);
+    return query;
 }
 
-void read_dictionary() {
-    char dict_type;
-    cin >> dict_type;
-    
-    int num_words;
-    cin >> num_words;
-    
-    string line;
-    // Clear the newline after the number
-    getline(cin, line);
-    
-    if (dict_type == 'S') {
-        // Simple dictionary
-        for (int i = 0; i < num_words; ++i) {
-            getline(cin, line);
-            
-            // Skip empty lines
-            if (line.empty()) {
-                --i;
-                continue;
-            }
-            
-            // Skip comment lines
-            if (line.length() >= 2 && line[0] == '/' && line[1] == '/') {
-                --i;
-                continue;
-            }
-            
-            add_word_to_dictionary(line);
-        }
-    } else if (dict_type == 'C') {
-        // Complex dictionary
-        for (int i = 0; i < num_words; ++i) {
-            getline(cin, line);
-            
-            // Skip empty lines
-            if (line.empty()) {
-                --i;
-                continue;
-            }
-            
-            // Skip comment lines
-            if (line.length() >= 2 && line[0] == '/' && line[1] == '/') {
-                --i;
-                continue;
-            }
-            
-            // Process the line and add all generated words
-            process_complex_word(line);
-        }
-    }
-    
-    // Continue reading any remaining lines (comments or empty lines at end)
-    while (getline(cin, line)) {
-        // Just consume and ignore
+// Parse a modification cost argument, exiting on anything but a small positive integer
+int parse_cost(const char* arg) {
+    char* end = nullptr;
+    long cost = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || cost < 1 || cost > 65535) {
+        cerr << "Error: Invalid cost " << arg << ". Use an integer from 1 to 65535.\n";
+        exit(1);
     }
-    
-    // Prepare dictionary for binary search
-    prepare_dictionary_for_search();
+    return static_cast<int>(cost);
 }
 
-// Generate all possible words from current word based on allowed modifications
-void generate_neighbors(int current_word_id, vector<int> &neighbors) {
-    const string& word = dictionary[current_word_id];
-    
-    assert(!word.empty());
-    assert(neighbors.empty());
-    assert(current_word_id >= 0 && current_word_id < static_cast<int>(dictionary.size()));
-    assert(parent_info[current_word_id] != -2); // Must be discovered
-    
-    // Pre-allocate reusable string buffer to avoid repeated allocations
-    string working_buffer;
-    working_buffer.reserve(word.length() + 5);
-    
-    // Change mode: change one letter
-    if (config.change_mode) {
-        for (size_t i = 0; i < word.length(); ++i) {
-            for (char c = 'a'; c <= 'z'; ++c) {
-                if (c != word[i]) {
-                    working_buffer = word;
-                    working_buffer[i] = c;
-                    
-                    int new_word_id = find_word_id(working_buffer);
-                    if (new_word_id != -1 && parent_info[new_word_id] == -2) {
-                        neighbors.push_back(new_word_id);
-                        parent_info[new_word_id] = current_word_id;
-                        
-                        // Only store modification details if needed
-                        if (!config.word_output) {
-                            mod_info[new_word_id].modification_type = 1; // 'c'
-                            mod_info[new_word_id].modification_pos = static_cast<unsigned char>(i);
-                            mod_info[new_word_id].modification_char = c;
-                        }
-                    }
-                }
-            }
-        }
+// Returns the error message for an invalid routing, word and modification
+// combination, or an empty string if the query can be run
+string find_query_error(const Config& config) {
+    if (config.use_stack && config.use_queue) {
+        return "Error: Cannot specify both stack and queue\n";
     }
-    
-    // Length mode: insert and delete
-    if (config.length_mode) {
-        // Insert a letter at each position
-        for (size_t i = 0; i <= word.length(); ++i) {
-            for (char c = 'a'; c <= 'z'; ++c) {
-                working_buffer = word;
-                working_buffer.insert(i, 1, c);
-                
-                int new_word_id = find_word_id(working_buffer);
-                if (new_word_id != -1 && parent_info[new_word_id] == -2) {
-                    neighbors.push_back(new_word_id);
-                    parent_info[new_word_id] = current_word_id;
-                    
-                    // Only store modification details if needed
-                    if (!config.word_output) {
-                        mod_info[new_word_id].modification_type = 2; // 'i'
-                        
-                        // Find the first difference position between parent and new word
-                        int first_diff = 0;
-                        while (first_diff < static_cast<int>(word.length()) && 
-                               first_diff < static_cast<int>(working_buffer.length()) && 
-                               word[first_diff] == working_buffer[first_diff]) {
-                            first_diff++;
-                        }
-                        
-                        mod_info[new_word_id].modification_pos = static_cast<unsigned char>(first_diff);
-                        mod_info[new_word_id].modification_char = c;
-                    }
-                }
-            }
-        }
-        
-        // Delete a letter at each position
-        for (size_t i = 0; i < word.length(); ++i) {
-            working_buffer = word;
-            working_buffer.erase(i, 1);
-            
-            int new_word_id = find_word_id(working_buffer);
-            if (new_word_id != -1 && parent_info[new_word_id] == -2) {
-                neighbors.push_back(new_word_id);
-                parent_info[new_word_id] = current_word_id;
-                
-                // Only store modification details if needed
-                if (!config.word_output) {
-                    mod_info[new_word_id].modification_type = 3; // 'd'
-                    
-                    // Find the first difference position between parent and new word
-                    int first_diff = 0;
-                    while (first_diff < static_cast<int>(working_buffer.length()) && 
-                           first_diff < static_cast<int>(word.length()) && 
-                           working_buffer[first_diff] == word[first_diff]) {
-                        first_diff++;
-                    }
-                    
-                    mod_info[new_word_id].modification_pos = static_cast<unsigned char>(first_diff);
-                }
-            }
-        }
+    if (config.use_dijkstra && (config.use_stack || config.use_queue)) {
+        return "Error: Cannot combine dijkstra with stack or queue\n";
     }
-    
-    // Swap mode: swap adjacent letters
-    if (config.swap_mode) {
-        for (size_t i = 0; i < word.length() - 1; ++i) {
-            working_buffer = word;
-            swap(working_buffer[i], working_buffer[i + 1]);
-            
-            int new_word_id = find_word_id(working_buffer);
-            if (new_word_id != -1 && parent_info[new_word_id] == -2) {
-                neighbors.push_back(new_word_id);
-                parent_info[new_word_id] = current_word_id;
-                
-                // Only store modification details if needed
-                if (!config.word_output) {
-                    mod_info[new_word_id].modification_type = 4; // 's'
-                    mod_info[new_word_id].modification_pos = static_cast<unsigned char>(i);
-                }
-            }
-        }
+    if (!config.use_stack && !config.use_queue && !config.use_dijkstra) {
+        return "Error: Must specify either stack or queue\n";
     }
-    
-    // Sort neighbors by their original dictionary order
-    sort(neighbors.begin(), neighbors.end());
-    // Use stable_sort with custom comparison
-    for (int i = 0; i < static_cast<int>(neighbors.size()); ++i) {
-        for (int j = i + 1; j < static_cast<int>(neighbors.size()); ++j) {
-            if (original_order[neighbors[i]] > original_order[neighbors[j]]) {
-                swap(neighbors[i], neighbors[j]);
-            }
-        }
+    if (config.begin_word.empty()) {
+        return "Error: Must specify begin word\n";
     }
-}
-
-// Reconstruct path from end word back to begin word
-void reconstruct_path(int begin_word_id, int end_word_id, vector <int> &path) {
-    int current = end_word_id;
-    
-    while (current != begin_word_id) {
-        path.push_back(current);
-        current = parent_info[current];
+    if (config.end_word.empty()) {
+        return "Error: Must specify end word\n";
     }
-    path.push_back(begin_word_id);
-    
-    reverse(path.begin(), path.end());
-}
-
-// BFS implementation
-bool search_bfs() {
-    deque<int> search_container;
-    
-    int begin_word_id = find_word_id(config.begin_word);
-    
-    // Initialize with begin word
-    search_container.push_back(begin_word_id);
-    parent_info[begin_word_id] = -1; // -1 means begin word (discovered but no parent)
-    
-    int end_word_id = find_word_id(config.end_word);
-    
-    while (!search_container.empty()) {
-        // Fetch and remove from front (queue behavior)
-        int current_word_id = search_container.front();
-        search_container.pop_front();
-        
-        // Check if we reached the end
-        if (current_word_id == end_word_id) {
-            return true;
-        }
-        
-        // Investigate: generate all valid neighbors
-        vector<int> neighbors;
-        generate_neighbors(current_word_id, neighbors);
-        
-        // Add neighbors to back of container (queue behavior)
-        for (size_t i = 0; i < neighbors.size(); ++i) {
-            search_container.push_back(neighbors[i]);
-            
-            // Check if we found the end word
-            if (neighbors[i] == end_word_id) {
-                return true;
-            }
-        }
+    if (!config.change_mode && !config.length_mode && !config.swap_mode) {
+        return "Error: Must specify at least one of change, length, or swap\n";
     }
-    
-    return false; // No path found
-}
-
-// DFS implementation  
-bool search_dfs() {
-    deque<int> search_container;
-    
-    int begin_word_id = find_word_id(config.begin_word);
-    
-    // Initialize with begin word
-    search_container.push_back(begin_word_id);
-    parent_info[begin_word_id] = -1; // -1 means begin word (discovered but no parent)
-    
-    int end_word_id = find_word_id(config.end_word);
-    
-    while (!search_container.empty()) {
-        // Fetch and remove from back (stack behavior - LIFO)
-        int current_word_id = search_container.back();
-        search_container.pop_back();
-        
-        // Check if we reached the end
-        if (current_word_id == end_word_id) {
-            return true;
-        }
-        
-        // Investigate: generate all valid neighbors
-        vector<int> neighbors;
-        generate_neighbors(current_word_id, neighbors);
-        
-        // Add neighbors to back of container in normal order (stack behavior)
-        for (size_t i = 0; i < neighbors.size(); ++i) {
-            search_container.push_back(neighbors[i]);
-            
-            // Check if we found the end word
-            if (neighbors[i] == end_word_id) {
-                return true;
-            }
-        }
-    }
-    
-    return false; // No path found
-}
-
-// Output functions
-void output_word_format(const vector<int>& path) {
-    cout << "Words in morph: " << path.size() << "\n";
-    for (size_t i = 0; i < path.size(); ++i) {
-        cout << dictionary[path[i]] << "\n";
-    }
-}
-
-void output_modification_format(const vector<int>& path) {
-    cout << "Words in morph: " << path.size() << "\n";
-    cout << dictionary[path[0]] << "\n"; // Start word
-    
-    for (size_t i = 1; i < path.size(); ++i) {
-        const ModificationInfo& info = mod_info[path[i]];
-        
-        if (info.modification_type == 1) { // 'c'
-            cout << "c," << static_cast<int>(info.modification_pos) << "," << info.modification_char << "\n";
-        } else if (info.modification_type == 2) { // 'i'
-            cout << "i," << static_cast<int>(info.modification_pos) << "," << info.modification_char << "\n";
-        } else if (info.modification_type == 3) { // 'd'
-            cout << "d," << static_cast<int>(info.modification_pos) << "\n";
-        } else if (info.modification_type == 4) { // 's'
-            cout << "s," << static_cast<int>(info.modification_pos) << "\n";
-        }
+    if ((config.change_mode || config.swap_mode) && !config.length_mode && 
+        config.begin_word.length() != config.end_word.length()) {
+        return "Error: Cannot change words of different lengths without length mode\n";
     }
+    return "";
 }
 
 Config parse_command_line(int argc, char* argv[]) {
     Config local_config;
+    bool costs_given = false;
+    
+    // Long-only options
+    enum { OPT_CHANGE_COST = 256, OPT_INSERT_COST, OPT_DELETE_COST, OPT_SWAP_COST, OPT_BATCH, OPT_THREADS, OPT_COMPACT, OPT_STATS, OPT_CACHE_MB, OPT_MEMORY_MB };
     
     // Define long options
     static struct option long_options[] = {
         {"help",    no_argument,       0, 'h'},
         {"queue",   no_argument,       0, 'q'},
         {"stack",   no_argument,       0, 's'},
+        {"dijkstra", no_argument,      0, 'd'},
         {"begin",   required_argument, 0, 'b'},
         {"end",     required_argument, 0, 'e'},
         {"output",  required_argument, 0, 'o'},
         {"change",  no_argument,       0, 'c'},
         {"length",  no_argument,       0, 'l'},
         {"swap",    no_argument,       0, 'p'},
+        {"change-cost", required_argument, 0, OPT_CHANGE_COST},
+        {"insert-cost", required_argument, 0, OPT_INSERT_COST},
+        {"delete-cost", required_argument, 0, OPT_DELETE_COST},
+        {"swap-cost",   required_argument, 0, OPT_SWAP_COST},
+        {"batch",       required_argument, 0, OPT_BATCH},
+        {"threads",     required_argument, 0, OPT_THREADS},
+        {"compact",     no_argument,       0, OPT_COMPACT},
+        {"stats",       no_argument,       0, OPT_STATS},
+        {"cache-mb",    required_argument, 0, OPT_CACHE_MB},
+        {"memory-mb",   required_argument, 0, OPT_MEMORY_MB},
         {0,         0,                 0, 0}
     };
     
@@ -511,7 +218,7 @@ Config parse_command_line(int argc, char* argv[]) {
     int opt;
     
     // Parse command line options
-    while ((opt = getopt_long(argc, argv, "hqsb:e:o:clp", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "hqsdb:e:o:clp", long_options, &option_index)) != -1) {
         switch (opt) {
             case 'h':
                 local_config.help_requested = true;
@@ -522,6 +229,9 @@ Config parse_command_line(int argc, char* argv[]) {
             case 's':
                 local_config.use_stack = true;
                 break;
+            case 'd':
+                local_config.use_dijkstra = true;
+                break;
             case 'b':
                 local_config.begin_word = optarg;
                 break;
@@ -547,6 +257,61 @@ Config parse_command_line(int argc, char* argv[]) {
             case 'p':
                 local_config.swap_mode = true;
                 break;
+            case OPT_CHANGE_COST:
+                local_config.costs[1] = parse_cost(optarg);
+                costs_given = true;
+                break;
+            case OPT_INSERT_COST:
+                local_config.costs[2] = parse_cost(optarg);
+                costs_given = true;
+                break;
+            case OPT_DELETE_COST:
+                local_config.costs[3] = parse_cost(optarg);
+                costs_given = true;
+                break;
+            case OPT_SWAP_COST:
+                local_config.costs[4] = parse_cost(optarg);
+                costs_given = true;
+                break;
+            case OPT_BATCH:
+                local_config.batch_file = optarg;
+                break;
+            case OPT_THREADS: {
+                char* end = nullptr;
+                long threads = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || threads < 1 || threads > 1024) {
+                    cerr << "Error: Invalid thread count " << optarg << ". Use an integer from 1 to 1024.\n";
+                    exit(1);
+                }
+                local_config.threads = static_cast<unsigned>(threads);
+                break;
+            }
+            case OPT_COMPACT:
+                local_config.compact = true;
+                break;
+            case OPT_STATS:
+                local_config.print_stats = true;
+                break;
+            case OPT_CACHE_MB: {
+                char* end = nullptr;
+                long megabytes = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || megabytes < 1 || megabytes > 1000000) {
+                    cerr << "Error: Invalid cache size " << optarg << ". Use an integer from 1 to 1000000.\n";
+                    exit(1);
+                }
+                local_config.cache_mb = static_cast<size_t>(megabytes);
+                break;
+            }
+            case OPT_MEMORY_MB: {
+                char* end = nullptr;
+                long megabytes = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || megabytes < 1 || megabytes > 1000000) {
+                    cerr << "Error: Invalid memory limit " << optarg << ". Use an integer from 1 to 1000000.\n";
+                    exit(1);
+                }
+                local_config.memory_mb = static_cast<size_t>(megabytes);
+                break;
+            }
             case '?':
                 exit(1);
                 break;
@@ -562,48 +327,263 @@ Config parse_command_line(int argc, char* argv[]) {
         exit(0);
     }
     
-    // Validate required options
-    if (local_config.use_stack && local_config.use_queue) {
-        cerr << "Error: Cannot specify both stack and queue\n";
+    if (local_config.compact && local_config.memory_mb != 0) {
+        cerr << "Error: --compact and --memory-mb are mutually exclusive\n";
         exit(1);
     }
-    if (!local_config.use_stack && !local_config.use_queue) {
-        cerr << "Error: Must specify either stack or queue\n";
-        exit(1);
+    
+    // Validate required options
+    if (!local_config.batch_file.empty()) {
+        if (local_config.use_stack || local_config.use_queue || local_config.use_dijkstra ||
+            local_config.change_mode || local_config.length_mode || local_config.swap_mode ||
+            !local_config.word_output || !local_config.begin_word.empty() || !local_config.end_word.empty()) {
+            cerr << "Error: Routing, words, modifications and output come from the batch file\n";
+            exit(1);
+        }
+        return local_config;
     }
-    if (local_config.begin_word.empty()) {
-        cerr << "Error: Must specify begin word\n";
+    if (local_config.threads != 0) {
+        cerr << "Error: Threads require batch mode\n";
         exit(1);
     }
-    if (local_config.end_word.empty()) {
-        cerr << "Error: Must specify end word\n";
+    if (local_config.cache_mb != 0) {
+        cerr << "Error: The search tree cache requires batch mode\n";
         exit(1);
     }
-    if (!local_config.change_mode && !local_config.length_mode && !local_config.swap_mode) {
-        cerr << "Error: Must specify at least one of change, length, or swap\n";
+    string error = find_query_error(local_config);
+    if (!error.empty()) {
+        cerr << error;
         exit(1);
     }
-    if ((local_config.change_mode || local_config.swap_mode) && !local_config.length_mode && 
-        local_config.begin_word.length() != local_config.end_word.length()) {
-        cerr << "Error: Cannot change words of different lengths without length mode\n";
+    if (costs_given && !local_config.use_dijkstra) {
+        cerr << "Error: Modification costs require dijkstra routing\n";
         exit(1);
     }
     
     return local_config;
 }
 
+// Fill in the routing, words and modes of one batch query line, "BEGIN END FLAGS".
+// Returns the error message for a malformed line, or an empty string.
+string parse_query_line(const string& line, Config& query_config) {
+    istringstream fields(line);
+    string flags;
+    string extra;
+    if (!(fields >> query_config.begin_word >> query_config.end_word >> flags) || (fields >> extra)) {
+        return "Error: Query must be BEGIN END FLAGS\n";
+    }
+    for (size_t i = 0; i < flags.length(); ++i) {
+        switch (flags[i]) {
+            case 's': query_config.use_stack = true; break;
+            case 'q': query_config.use_queue = true; break;
+            case 'd': query_config.use_dijkstra = true; break;
+            case 'c': query_config.change_mode = true; break;
+            case 'l': query_config.length_mode = true; break;
+            case 'p': query_config.swap_mode = true; break;
+            case 'W': query_config.word_output = true; break;
+            case 'M': query_config.word_output = false; break;
+            default:
+                return string("Error: Unknown query flag ") + flags[i] + "\n";
+        }
+    }
+    return find_query_error(query_config);
+}
+
+// Least recently used cache of parent trees, bounded by their total memory
+// and shared by the batch workers. Trees are immutable once inserted, so a
+// worker keeps using one it found even if it is evicted meanwhile.
+struct ParentTreeCache {
+    size_t capacity = 0;  // Bytes
+    size_t memory = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+
+    typedef pair<uint64_t, shared_ptr<const ParentTree> > Entry;
+    list<Entry> entries;  // Most recently used first
+    unordered_map<uint64_t, list<Entry>::iterator> index;
+    mutex cache_mutex;
+
+    // Begin word, modes and routing identify the tree
+    static uint64_t key(const Query& query) {
+        return (static_cast<uint64_t>(query.begin_word_id) << 8) | (query.modes << 2) |
+               static_cast<uint64_t>(query.routing);
+    }
+
+    shared_ptr<const ParentTree> find(uint64_t tree_key) {
+        lock_guard<mutex> lock(cache_mutex);
+        unordered_map<uint64_t, list<Entry>::iterator>::iterator it = index.find(tree_key);
+        if (it == index.end()) {
+            ++misses;
+            return nullptr;
+        }
+        ++hits;
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->second;
+    }
+
+    void insert(uint64_t tree_key, const shared_ptr<const ParentTree>& tree) {
+        lock_guard<mutex> lock(cache_mutex);
+        size_t tree_memory = tree->memory_usage();
+        if (tree_memory > capacity || index.count(tree_key) != 0) {
+            return; // Too big to cache, or another worker already built it
+        }
+        while (memory + tree_memory > capacity) {
+            memory -= entries.back().second->memory_usage();
+            index.erase(entries.back().first);
+            entries.pop_back();
+            ++evictions;
+        }
+        entries.push_front(Entry(tree_key, tree));
+        index[tree_key] = entries.begin();
+        memory += tree_memory;
+    }
+};
+
+// Report how well the Bloom filter screened candidate lookups
+void print_stats(const WordGraph& graph, const SearchStats& stats) {
+    uint64_t negatives = stats.filter_rejections + stats.false_positives;
+    double false_positive_rate = negatives == 0 ? 0.0 : 100.0 * static_cast<double>(stats.false_positives)
+                                                      / static_cast<double>(negatives);
+    cerr << "Bloom filter memory: " << graph.filter_memory_usage() << " bytes\n"
+         << "Candidate lookups: " << stats.candidate_lookups << "\n"
+         << "Rejected by filter: " << stats.filter_rejections << "\n"
+         << "Filter false positives: " << stats.false_positives
+         << " (" << fixed << setprecision(3) << false_positive_rate << "% of non-words)\n";
+}
+
+// Answer one batch query into out. Problems are reported inline rather than
+// on cerr so every query's output stays in its input position.
+void answer_batch_query(const WordGraph& graph, SearchContext& context, ParentTreeCache* cache,
+                        const Config& config, const string& line, ostream& out) {
+    Config query_config = config;
+    string error = parse_query_line(line, query_config);
+    if (!error.empty()) {
+        out << error;
+        return;
+    }
+    
+    int begin_word_id = graph.find_word_id(query_config.begin_word);
+    int end_word_id = graph.find_word_id(query_config.end_word);
+    if (begin_word_id == -1) {
+        out << "Error: Begin word not found in dictionary\n";
+        return;
+    }
+    if (end_word_id == -1) {
+        out << "Error: End word not found in dictionary\n";
+        return;
+    }
+    
+    Query query = make_query(query_config, begin_word_id, end_word_id);
+    if (cache == nullptr || query.routing == Routing::Dijkstra) {
+        output_result(graph, context.search(query), query_config, out);
+        return;
+    }
+    
+    // Answer from the begin word's tree, traversing everything on a miss
+    uint64_t tree_key = ParentTreeCache::key(query);
+    shared_ptr<const ParentTree> tree = cache->find(tree_key);
+    if (!tree) {
+        shared_ptr<ParentTree> new_tree = make_shared<ParentTree>();
+        context.build_parent_tree(query, *new_tree);
+        cache->insert(tree_key, new_tree);
+        tree = new_tree;
+    }
+    output_result(graph, tree->answer(end_word_id), query_config, out);
+}
+
+// Solve every query in the batch file on a pool of worker threads. Each
+// worker owns a SearchContext over the shared graph and claims the next
+// unsolved query, so uneven queries balance themselves; output is buffered
+// per query and printed in input order once all workers finish.
+void run_batch(const WordGraph& graph, const Config& config) {
+    ifstream batch(config.batch_file);
+    if (!batch) {
+        cerr << "Error: Cannot open batch file " << config.batch_file << "\n";
+        exit(1);
+    }
+    
+    // Collect queries, skipping blank and comment lines
+    vector<string> queries;
+    string line;
+    while (getline(batch, line)) {
+        if (line.find_first_not_of(" \t\r") == string::npos ||
+            (line.length() >= 2 && line[0] == '/' && line[1] == '/')) {
+            continue;
+        }
+        queries.push_back(line);
+    }
+    
+    unsigned num_threads = config.threads;
+    if (num_threads == 0) {
+        num_threads = max(1u, thread::hardware_concurrency());
+    }
+    num_threads = static_cast<unsigned>(min<size_t>(num_threads, max<size_t>(queries.size(), 1)));
+    
+    vector<string> results(queries.size());
+    atomic<size_t> next_query(0);
+    SearchStats total_stats;
+    mutex stats_mutex;
+    ParentTreeCache cache;
+    cache.capacity = config.cache_mb << 20;
+    ParentTreeCache* shared_cache = config.cache_mb != 0 ? &cache : nullptr;
+    auto worker = [&]() {
+        SearchContext context(graph);
+        ostringstream out;
+        for (size_t i = next_query++; i < queries.size(); i = next_query++) {
+            out.str("");
+            answer_batch_query(graph, context, shared_cache, config, queries[i], out);
+            results[i] = out.str();
+        }
+        lock_guard<mutex> lock(stats_mutex);
+        total_stats += context.stats();
+    };
+    
+    vector<thread> workers;
+    for (unsigned i = 1; i < num_threads; ++i) {
+        workers.emplace_back(worker);
+    }
+    worker(); // The main thread works too
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+    
+    for (size_t i = 0; i < results.size(); ++i) {
+        cout << results[i];
+    }
+    if (config.print_stats) {
+        cout << flush;
+        print_stats(graph, total_stats);
+        if (shared_cache != nullptr) {
+            cerr << "Tree cache: " << cache.hits << " hits, " << cache.misses << " misses, "
+                 << cache.evictions << " evictions, " << cache.memory << " bytes in "
+                 << cache.entries.size() << " trees\n";
+        }
+    }
+}
+
 int main(int argc, char* argv[]) {
     ios_base::sync_with_stdio(false);
     cin.tie(0);
     
-    config = parse_command_line(argc, argv);
+    Config config = parse_command_line(argc, argv);
     
     // Read the dictionary from cin
-    read_dictionary();
+    WordGraphOptions options;
+    options.compact = config.compact;
+    options.anagram_index = config.swap_mode || !config.batch_file.empty();
+    options.memory_limit = config.memory_mb << 20;
+    DictionaryReader reader(cin);
+    WordGraph graph(reader, options);
+    
+    if (!config.batch_file.empty()) {
+        run_batch(graph, config);
+        return 0;
+    }
     
     // Check if begin and end words exist in dictionary
-    int begin_word_id = find_word_id(config.begin_word);
-    int end_word_id = find_word_id(config.end_word);
+    int begin_word_id = graph.find_word_id(config.begin_word);
+    int end_word_id = graph.find_word_id(config.end_word);
     
     if (begin_word_id == -1) {
         cerr << "Error: Begin word not found in dictionary\n";
@@ -615,34 +595,12 @@ int main(int argc, char* argv[]) {
     }
     
     // Perform search
-    bool found = false;
-    if (config.use_queue) {
-        found = search_bfs();
-    } else {
-        found = search_dfs();
-    }
-    
-    if (found) {
-        // Reconstruct and output the path
-        vector<int> path;
-        reconstruct_path(begin_word_id, end_word_id, path);
-        
-        if (config.word_output) {
-            output_word_format(path);
-        } else {
-            output_modification_format(path);
-        }
-    }
-    else
-    {
-        // Count discovered words for "No solution" message
-        int discovered_count = 0;
-        for (size_t i = 0; i < parent_info.size(); ++i) {
-            if (parent_info[i] != -2) { // If not undiscovered
-                discovered_count++;
-            }
-        }
-        cout << "No solution, " << discovered_count << " words discovered.\n";
+    SearchContext context(graph);
+    QueryResult result = context.search(make_query(config, begin_word_id, end_word_id));
+    output_result(graph, result, config, cout);
+    if (config.print_stats) {
+        cout << flush;
+        print_stats(graph, context.stats());
     }
     
     return 0;
@@ -3,13 +3,58 @@
  * EECS 370 LC-2K Instruction-level simulator
  *
  * Make sure to NOT modify printState or any of the associated functions
+ *
+ * Usage: simulator [-f] [-i] [-j] [-p] [-s SYMBOLS] [-t N] [-w LOW:HIGH]
+ *                  [-c CHECKPOINT [-n N]] [-m LEVEL ... [-M CYCLES]]
+ *                  <machine-code file>
+ *        simulator [options] -r CHECKPOINT
+ *        simulator [-f] [-i] -b LIST [-J JOBS] [-o DIR]
+ *   -f           fast run: print only the final state and statistics
+ *   -i           machine code is a raw image of little-endian 32-bit words
+ *                rather than hex text
+ *   -t N         fast run, also printing the state before every Nth instruction
+ *   -w LOW:HIGH  fast run, also printing the state before instructions whose
+ *                pc is in [LOW, HIGH]; combines with -t
+ *   -j           fast run that compiles hot basic blocks to x86-64 (Linux on
+ *                x86-64 only; elsewhere the interpreter runs instead)
+ *   -p           profile the run and print a hot-spot report after the final
+ *                state
+ *   -s SYMBOLS   label the report with a symbol map written by the assembler
+ *   -c FILE      write a checkpoint to FILE on SIGUSR1 and, with -n N, before
+ *                every Nth instruction; each one replaces the last atomically
+ *   -r FILE      resume from a checkpoint instead of loading a program
+ *   -m SIZE:ASSOC:BLOCK:wb|wt[:LATENCY]
+ *                model a data cache level for lw and sw (sizes in words;
+ *                write-back allocates on a write miss, write-through does not;
+ *                latency defaults to 1 cycle); repeat for L2, L3, ...
+ *   -M CYCLES    memory latency behind the last cache level (default 100)
+ *   -b LIST      run every machine-code file named in LIST (one per line),
+ *                up to JOBS at once (-J, default one per CPU); each output
+ *                goes to DIR/<name>.out with -o, otherwise to stdout in list
+ *                order under a "==> file <==" header
+ * Without options every step is printed, as the spec requires.
  */
 
+#define _DEFAULT_SOURCE
+
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// The JIT emits x86-64 code into mmap'd pages
+#if defined(__x86_64__) && defined(__linux__) && !defined(__STRICT_ANSI__)
+#define JIT_AVAILABLE 1
+#endif
 
 //DO NOT CHANGE THE FOLLOWING DEFINITIONS 
 
@@ -39,127 +84,237 @@ stateStruct {
     int numInstructionsExecuted;
 } stateType;
 
+// Instruction decoded once and reused until its memory word changes.
+// Entries start out as DECODE and are decoded on first execution.
+#define DECODE 8
+
+typedef struct
+decodedStruct {
+    uint8_t opcode;
+    uint8_t regA;
+    uint8_t regB;
+    uint8_t destReg;
+    int32_t offset;
+} decodedType;
+
+static decodedType decoded[MEMORYSIZE];
+
+// Which steps print their state
+#define TRACE_ALL 0
+#define TRACE_NONE 1
+#define TRACE_FILTERED 2
+
+static int traceMode = TRACE_ALL;
+static int traceEvery = 0;           // Sample interval; 0 traces every step
+static int traceLow = 0;             // Pc window, inclusive
+static int traceHigh = -1;           // Below traceLow when there is no window
+
+// Profile counters, only touched with -p
+static bool profiling = false;
+static uint64_t profileOpcodes[NOOP + 1];
+static uint64_t profilePc[MEMORYSIZE];
+static uint64_t profileTaken[MEMORYSIZE];
+static uint64_t profileNotTaken[MEMORYSIZE];
+static uint64_t profileLoads[MEMORYSIZE];
+static uint64_t profileStores[MEMORYSIZE];
+
+// Data cache hierarchy modelled with -m, L1 first
+#define CACHE_MAX_LEVELS 4
+
+typedef struct
+cacheLineStruct {
+    int block;             // Memory address / block size
+    bool valid;
+    bool dirty;
+    uint64_t lastUsed;     // For LRU replacement
+} cacheLineType;
+
+typedef struct
+cacheLevelStruct {
+    int size;              // In words
+    int associativity;
+    int blockSize;         // In words
+    bool writeBack;        // Otherwise write-through, no write-allocate
+    int latency;           // Cycles per access
+    int numSets;
+    cacheLineType *lines;  // numSets * associativity
+    uint64_t clock;
+    uint64_t hits, misses, evictions, writebacks;
+} cacheLevelType;
+
+static cacheLevelType cacheLevels[CACHE_MAX_LEVELS];
+static int numCacheLevels = 0;
+static int memoryLatency = 100;
+static uint64_t memoryReads, memoryWrites;
+static uint64_t dataCycles;            // Spent in lw and sw accesses
+
+// Machine code is a binary image (-i) rather than hex text
+static bool imageInput = false;
+
+// loadProgram results
+#define LOAD_OK 0
+#define LOAD_CANT_OPEN 1
+#define LOAD_TOO_BIG 2         // "exceeded memory size"
+#define LOAD_BAD_WORD 3        // "error in reading address N"
+#define LOAD_BAD_IMAGE 4       // Image size is not a whole number of words
+
+// Checkpoints: file, interval (0 for signal only) and restore source
+static char *checkpointFile = NULL;
+static char *checkpointTempFile;
+static int checkpointEvery = 0;
+static int nextCheckpoint = INT_MAX;
+static volatile sig_atomic_t checkpointRequested = 0;
+static char *restoreFile = NULL;
+
+// Batch runner: list of programs, jobs run at once and per-program output directory
+static char *batchFile = NULL;
+static int batchJobLimit = 0;
+static char *batchOutputDir = NULL;
+
+// Symbol map from the assembler, sorted by address
+typedef struct
+symbolStruct {
+    int address;
+    char *name;
+} symbolType;
+
+static symbolType *symbols;
+static int numSymbols;
+
+// Output goes through one large buffer; the dumps are most of the run time
+static char outputBuffer[1 << 20];
+
 void printState(stateType *);
 
 void printStats(stateType *);
 
 static inline int convertNum(int32_t);
 
+static void decodeInstruction(int, decodedType *);
+
+static void execute(stateType *, bool);
+
+static bool isTraced(int, int);
+
+static void parseOptions(int, char **);
+
+static void readSymbols(const char *);
+
+static int loadProgram(const char *, int *, int *);
+
+static void loadMachineCode(const char *, stateType *);
+
+static void runMachine(stateType *);
+
+static void addCacheLevel(const char *);
+
+static void cacheStep(int, const int *, const int *);
+
+static void printCacheReport(stateType *);
+
+static void profileStep(int, const int *, const int *);
+
+static void writeCheckpoint(stateType *);
+
+static void readCheckpoint(stateType *);
+
+static void scheduleCheckpoint(int);
+
+static void printProfile(stateType *);
+
+static int runBatch(void);
+
+static bool useJit = false;
+
+#ifdef JIT_AVAILABLE
+static void executeJit(stateType *);
+
+static void jitFlush(void);
+
+static uint8_t jitCovered[MEMORYSIZE];  // Nonzero for words compiled into some block
+#endif
+
+// Dispatch through computed gotos (labels as values) where the compiler
+// supports them (GNU C modes); build with -DSIM_PORTABLE_DISPATCH for the
+// plain switch
+#if defined(__GNUC__) && !defined(__STRICT_ANSI__) && !defined(SIM_PORTABLE_DISPATCH)
+#define THREADED_DISPATCH 1
+#endif
+
 
 int 
 main(int argc, char **argv)
 {
-    char line[MAXLINELENGTH];
     stateType state = {0};
-    FILE *filePtr;
 
-    if (argc != 2) {
+    parseOptions(argc, argv);
+
+    // Before any batch jobs fork, so they share the table copy-on-write
+    for (int i = 0; i < MEMORYSIZE; i++) {
+        decoded[i].opcode = DECODE;
+    }
+
+    if (batchFile != NULL && argc == optind) {
+        return runBatch();
+    }
+    if (argc - optind != (restoreFile == NULL && batchFile == NULL ? 1 : 0)) {
         printf("error: usage: %s <machine-code file>\n", argv[0]);
         exit(1);
     }
 
-    filePtr = fopen(argv[1], "r");
-    if (filePtr == NULL) {
-        printf("error: can't open file %s , please ensure you are providing the correct path", argv[1]);
-        perror("fopen");
-        exit(2);
+    if (restoreFile != NULL) {
+        setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+        readCheckpoint(&state);
+    } else {
+        loadMachineCode(argv[optind], &state);
     }
+    runMachine(&state);
 
-    /* read the entire machine-code file into memory */
-    for (state.numMemory=0; fgets(line, MAXLINELENGTH, filePtr) != NULL; state.numMemory++) {
-		    if (state.numMemory >= MEMORYSIZE) {
-			      fprintf(stderr, "exceeded memory size\n");
-			      exit(2);
-		    }
-		    if (sscanf(line, "%x", state.mem+state.numMemory) != 1) {
-			      fprintf(stderr, "error in reading address %d\n", state.numMemory);
-			      exit(2);
-		    }
-            printf("mem[ %d ] 0x%08X\n", state.numMemory, state.mem[state.numMemory]);
-    }
+    return(0);
+}
 
-    fclose(filePtr);
+// Read the entire machine-code file into memory, echoing it unless -f;
+// exits 2 if it cannot be loaded
+static void loadMachineCode(const char *fileName, stateType *statePtr)
+{
+    int status = loadProgram(fileName, statePtr->mem, &statePtr->numMemory);
+    if (status == LOAD_CANT_OPEN) {
+        printf("error: can't open file %s , please ensure you are providing the correct path", fileName);
+        perror("fopen");
+        exit(2);
+    }
+    setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
 
-    // Main execution loop
-    while (1) {
-        printState(&state);
-        
-        // Fetch instruction
-        int instruction = state.mem[state.pc];
-        
-        // Increment PC
-        state.pc++;
-        
-        // Increment instruction count
-        state.numInstructionsExecuted++;
-        
-        // Decode instruction
-        int opcode = (instruction >> 22) & 0x7;
-        int regA = (instruction >> 19) & 0x7;
-        int regB = (instruction >> 16) & 0x7;
-        int destReg = instruction & 0x7;
-        int offset = convertNum(instruction & 0xFFFF);
-        
-        // Execute instruction
-        switch (opcode) {
-            case ADD:
-                state.reg[destReg] = state.reg[regA] + state.reg[regB];
-                break;
-                
-            case NOR:
-                state.reg[destReg] = ~(state.reg[regA] | state.reg[regB]);
-                break;
-                
-            case LW:
-                {
-                    int address = state.reg[regA] + offset;
-                    if (address < 0 || address >= MEMORYSIZE) {
-                        printf("error: memory access out of bounds at address %d\n", address);
-                        exit(1);
-                    }
-                    state.reg[regB] = state.mem[address];
-                }
-                break;
-                
-            case SW:
-                {
-                    int address = state.reg[regA] + offset;
-                    if (address < 0 || address >= MEMORYSIZE) {
-                        printf("error: memory access out of bounds at address %d\n", address);
-                        exit(1);
-                    }
-                    state.mem[address] = state.reg[regB];
-                }
-                break;
-                
-            case BEQ:
-                if (state.reg[regA] == state.reg[regB]) {
-                    state.pc = state.pc + offset;
-                }
-                break;
-                
-            case JALR:
-                state.reg[regB] = state.pc;
-                state.pc = state.reg[regA];
-                break;
-                
-            case HALT:
-                printStats(&state);
-                printState(&state);
-                exit(0);
-                break;
-                
-            case NOOP:
-                // Do nothing
-                break;
-                
-            default:
-                printf("error: unrecognized opcode %d\n", opcode);
-                exit(1);
+    // Words before a bad one are echoed, as when they were read line by line
+    if (traceMode == TRACE_ALL) {
+        for (int i = 0; i < statePtr->numMemory; i++) {
+            printf("mem[ %d ] 0x%08X\n", i, statePtr->mem[i]);
         }
     }
+    if (status == LOAD_TOO_BIG) {
+        fprintf(stderr, "exceeded memory size\n");
+        exit(2);
+    }
+    if (status == LOAD_BAD_WORD) {
+        fprintf(stderr, "error in reading address %d\n", statePtr->numMemory);
+        exit(2);
+    }
+    if (status == LOAD_BAD_IMAGE) {
+        fprintf(stderr, "error: image size is not a multiple of 4 bytes\n");
+        exit(2);
+    }
+}
 
-    return(0);
+// Run a loaded or restored machine until it halts
+static void runMachine(stateType *statePtr)
+{
+    scheduleCheckpoint(statePtr->numInstructionsExecuted);
+#ifdef JIT_AVAILABLE
+    if (useJit) {
+        executeJit(statePtr);
+    }
+#endif
+    execute(statePtr, false);
 }
 
 /*
@@ -203,4 +358,1318 @@ void printStats(stateType *statePtr)
 
 /*
 * Write any helper functions that you wish down here. 
-*/
\ No newline at end of file
+*/
+
+// Split an instruction word into its fields
+static void decodeInstruction(int instruction, decodedType *inst)
+{
+    inst->opcode = (instruction >> 22) & 0x7;
+    inst->regA = (instruction >> 19) & 0x7;
+    inst->regB = (instruction >> 16) & 0x7;
+    inst->destReg = instruction & 0x7;
+    inst->offset = convertNum(instruction & 0xFFFF);
+}
+
+// Copy the execution loop's locals back before the state is printed
+#define SYNC_STATE() do { \
+        statePtr->pc = pc; \
+        memcpy(statePtr->reg, reg, sizeof(reg)); \
+        statePtr->numInstructionsExecuted = numInstructionsExecuted; \
+    } while (0)
+
+// Run the per-step hooks (trace, -p profile, cache model, checkpoint), all
+// gated by one local flag, then fetch the instruction at pc and advance.
+#define FETCH() do { \
+        if (stepHooks) { \
+            if (tracing && \
+                (traceMode == TRACE_ALL || isTraced(pc, numInstructionsExecuted))) { \
+                SYNC_STATE(); \
+                printState(statePtr); \
+            } \
+            if (profile) { \
+                profileStep(pc, reg, mem); \
+            } \
+            if (caching) { \
+                cacheStep(pc, reg, mem); \
+            } \
+            if (checkpointing && \
+                (numInstructionsExecuted >= nextCheckpoint || checkpointRequested)) { \
+                SYNC_STATE(); \
+                writeCheckpoint(statePtr); \
+            } \
+        } \
+        inst = &decoded[pc]; \
+        pc++; \
+        numInstructionsExecuted++; \
+    } while (0)
+
+#ifdef THREADED_DISPATCH
+#define HANDLER(op) op_##op:
+#define DISPATCH() goto *handlers[inst->opcode]
+#define NEXT() do { FETCH(); DISPATCH(); } while (0)
+#else
+#define HANDLER(op) case op:
+#define DISPATCH() goto dispatch
+#define NEXT() break
+#endif
+
+// Run the loaded program until it halts, or with stopAtBranch only up to
+// and including the next beq or jalr. The pc, registers and instruction
+// count live in locals and are written back to the state only to print it.
+static void execute(stateType *statePtr, bool stopAtBranch)
+{
+    int pc = statePtr->pc;
+    int reg[NUMREGS];
+    int numInstructionsExecuted = statePtr->numInstructionsExecuted;
+    int *mem = statePtr->mem;
+    decodedType *inst;
+    const bool tracing = traceMode != TRACE_NONE;
+    const bool profile = profiling;
+    const bool checkpointing = checkpointFile != NULL;
+    const bool caching = numCacheLevels != 0;
+    const bool stepHooks = tracing || profile || checkpointing || caching;
+    memcpy(reg, statePtr->reg, sizeof(reg));
+
+#ifdef THREADED_DISPATCH
+    static void *handlers[] = {
+        &&op_ADD, &&op_NOR, &&op_LW, &&op_SW, &&op_BEQ, &&op_JALR, &&op_HALT, &&op_NOOP, &&op_DECODE
+    };
+    NEXT();
+#else
+    while (1) {
+        FETCH();
+    dispatch:
+        switch (inst->opcode) {
+#endif
+
+    HANDLER(ADD)
+        reg[inst->destReg] = reg[inst->regA] + reg[inst->regB];
+        NEXT();
+
+    HANDLER(NOR)
+        reg[inst->destReg] = ~(reg[inst->regA] | reg[inst->regB]);
+        NEXT();
+
+    HANDLER(LW)
+        {
+            int address = reg[inst->regA] + inst->offset;
+            if (address < 0 || address >= MEMORYSIZE) {
+                printf("error: memory access out of bounds at address %d\n", address);
+                exit(1);
+            }
+            reg[inst->regB] = mem[address];
+        }
+        NEXT();
+
+    HANDLER(SW)
+        {
+            int address = reg[inst->regA] + inst->offset;
+            if (address < 0 || address >= MEMORYSIZE) {
+                printf("error: memory access out of bounds at address %d\n", address);
+                exit(1);
+            }
+            mem[address] = reg[inst->regB];
+            // The word may be code; decode it again if it runs
+            decoded[address].opcode = DECODE;
+#ifdef JIT_AVAILABLE
+            if (jitCovered[address]) {
+                jitFlush();
+            }
+#endif
+        }
+        NEXT();
+
+    HANDLER(BEQ)
+        if (reg[inst->regA] == reg[inst->regB]) {
+            pc = pc + inst->offset;
+        }
+        if (stopAtBranch) {
+            SYNC_STATE();
+            return;
+        }
+        NEXT();
+
+    HANDLER(JALR)
+        reg[inst->regB] = pc;
+        pc = reg[inst->regA];
+        if (stopAtBranch) {
+            SYNC_STATE();
+            return;
+        }
+        NEXT();
+
+    HANDLER(HALT)
+        SYNC_STATE();
+        printStats(statePtr);
+        printState(statePtr);
+        if (profiling) {
+            printProfile(statePtr);
+        }
+        if (numCacheLevels != 0) {
+            printCacheReport(statePtr);
+        }
+        exit(0);
+
+    HANDLER(NOOP)
+        NEXT();
+
+    HANDLER(DECODE)
+        // First execution since load or since an SW wrote this word
+        decodeInstruction(mem[pc - 1], inst);
+        DISPATCH();
+
+#ifndef THREADED_DISPATCH
+        }
+    }
+#endif
+}
+
+// Whether a filtered trace prints the step about to run
+static bool isTraced(int pc, int numInstructionsExecuted)
+{
+    if (traceEvery != 0 && numInstructionsExecuted % traceEvery != 0) {
+        return false;
+    }
+    return traceLow > traceHigh || (pc >= traceLow && pc <= traceHigh);
+}
+
+static void requestCheckpoint(int signalNumber)
+{
+    (void)signalNumber;
+    checkpointRequested = 1;
+}
+
+// Read the options; the file name, if any, is left at argv[optind]
+static void parseOptions(int argc, char **argv)
+{
+    int opt;
+    char *end;
+    while ((opt = getopt(argc, argv, "b:c:fijJ:m:M:n:o:pr:s:t:w:")) != -1) {
+        switch (opt) {
+            case 'f':
+                if (traceMode == TRACE_ALL) {
+                    traceMode = TRACE_NONE;
+                }
+                break;
+            case 'i':
+                imageInput = true;
+                break;
+            case 'j':
+                useJit = true;
+                break;
+            case 'p':
+                profiling = true;
+                break;
+            case 's':
+                readSymbols(optarg);
+                break;
+            case 'c':
+                checkpointFile = optarg;
+                break;
+            case 'n':
+                checkpointEvery = (int)strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || checkpointEvery < 1) {
+                    printf("error: checkpoint interval must be a positive integer\n");
+                    exit(1);
+                }
+                break;
+            case 'r':
+                restoreFile = optarg;
+                break;
+            case 'b':
+                batchFile = optarg;
+                break;
+            case 'J':
+                batchJobLimit = (int)strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || batchJobLimit < 1) {
+                    printf("error: job count must be a positive integer\n");
+                    exit(1);
+                }
+                break;
+            case 'o':
+                batchOutputDir = optarg;
+                break;
+            case 'm':
+                addCacheLevel(optarg);
+                break;
+            case 'M':
+                memoryLatency = (int)strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || memoryLatency < 0) {
+                    printf("error: memory latency must be a nonnegative integer\n");
+                    exit(1);
+                }
+                break;
+            case 't':
+                traceEvery = (int)strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || traceEvery < 1) {
+                    printf("error: trace interval must be a positive integer\n");
+                    exit(1);
+                }
+                traceMode = TRACE_FILTERED;
+                break;
+            case 'w':
+                traceLow = (int)strtol(optarg, &end, 10);
+                if (end == optarg || *end != ':') {
+                    printf("error: trace window must be LOW:HIGH\n");
+                    exit(1);
+                }
+                optarg = end + 1;
+                traceHigh = (int)strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || traceHigh < traceLow) {
+                    printf("error: trace window must be LOW:HIGH\n");
+                    exit(1);
+                }
+                traceMode = TRACE_FILTERED;
+                break;
+            default:
+                printf("error: usage: %s [-f] [-i] [-j] [-p] [-s SYMBOLS] [-t N] [-w LOW:HIGH] "
+                       "[-c CHECKPOINT [-n N]] [-m LEVEL ... [-M CYCLES]] "
+                       "<machine-code file> | -r CHECKPOINT | -b LIST [-J JOBS] [-o DIR]\n", argv[0]);
+                exit(1);
+        }
+    }
+    if (batchFile != NULL && (traceMode == TRACE_FILTERED || useJit || profiling ||
+                              checkpointFile != NULL || restoreFile != NULL || numCacheLevels != 0)) {
+        printf("error: -b only combines with -f, -i, -J and -o\n");
+        exit(1);
+    }
+    if (batchFile == NULL && (batchJobLimit != 0 || batchOutputDir != NULL)) {
+        printf("error: -J and -o need a program list (-b)\n");
+        exit(1);
+    }
+    if (checkpointEvery != 0 && checkpointFile == NULL) {
+        printf("error: -n needs a checkpoint file (-c)\n");
+        exit(1);
+    }
+    if (checkpointFile != NULL) {
+        // Checkpoints are written here first, then renamed over the file
+        checkpointTempFile = malloc(strlen(checkpointFile) + sizeof(".tmp"));
+        if (checkpointTempFile == NULL) {
+            printf("error: out of memory\n");
+            exit(1);
+        }
+        sprintf(checkpointTempFile, "%s.tmp", checkpointFile);
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = requestCheckpoint;
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGUSR1, &action, NULL);
+    }
+    if (useJit) {
+        if (traceMode == TRACE_FILTERED || profiling || checkpointFile != NULL ||
+            numCacheLevels != 0) {
+            printf("error: -j cannot be combined with -c, -m, -p, -t or -w\n");
+            exit(1);
+        }
+        traceMode = TRACE_NONE;
+#ifndef JIT_AVAILABLE
+        fprintf(stderr, "note: no JIT on this platform, interpreting instead\n");
+        useJit = false;
+#endif
+    }
+}
+
+// One more than the value of each hex digit character; 0 for anything else
+static const unsigned char hexDigitTable[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+// Value of a hex digit, or -1
+static int hexValue(char c)
+{
+    return hexDigitTable[(unsigned char)c] - 1;
+}
+
+/*
+ * sscanf(line, "%x", word) == 1 for the line [p, end), without the locale
+ * and format machinery: skip white space, take an optional sign and 0x, then
+ * convert like strtoul and keep the low 32 bits. A bare "0x" reads as 0.
+ */
+static bool parseHexWord(const char *p, const char *end, int *word)
+{
+    while (p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r'))) {
+        p++;
+    }
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    if (p == end || hexValue(*p) < 0) {
+        return false;
+    }
+    if (end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        p += 2;
+    }
+    unsigned long value = 0;
+    bool overflow = false;
+    int digit;
+    for (; p < end && (digit = hexValue(*p)) >= 0; p++) {
+        if (value > ULONG_MAX >> 4) {
+            overflow = true;
+        }
+        value = (value << 4) | (unsigned long)digit;
+    }
+    if (overflow) {
+        value = ULONG_MAX;
+    } else if (negative) {
+        value = -value;
+    }
+    *word = (int)(unsigned int)value;
+    return true;
+}
+
+/*
+ * Read the hex text of a machine-code file, split into lines exactly as the
+ * old fgets(line, MAXLINELENGTH) loop saw them: up to and including a newline,
+ * or MAXLINELENGTH - 1 characters of a longer line. numWords is the count
+ * read before any error.
+ */
+static int parseMachineCode(const char *text, size_t size, int *words, int *numWords)
+{
+    const char *p = text;
+    const char *end = text + size;
+    *numWords = 0;
+    while (p < end) {
+        size_t limit = (size_t)(end - p) < MAXLINELENGTH - 1 ? (size_t)(end - p) : MAXLINELENGTH - 1;
+        const char *newline = memchr(p, '\n', limit);
+        const char *lineEnd = newline != NULL ? newline + 1 : p + limit;
+        // sscanf stopped at a NUL byte
+        const char *nul = memchr(p, '\0', (size_t)(lineEnd - p));
+        if (*numWords >= MEMORYSIZE) {
+            return LOAD_TOO_BIG;
+        }
+        if (!parseHexWord(p, nul != NULL ? nul : lineEnd, &words[*numWords])) {
+            return LOAD_BAD_WORD;
+        }
+        (*numWords)++;
+        p = lineEnd;
+    }
+    return LOAD_OK;
+}
+
+// Copy a raw image of little-endian words out of its mapping
+static int loadImage(int fd, int *words, int *numWords)
+{
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size % 4 != 0) {
+        return LOAD_BAD_IMAGE;
+    }
+    if (info.st_size / 4 > MEMORYSIZE) {
+        *numWords = 0;
+        return LOAD_TOO_BIG;
+    }
+    *numWords = (int)(info.st_size / 4);
+    if (*numWords == 0) {
+        return LOAD_OK;
+    }
+    const unsigned char *bytes = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (bytes == MAP_FAILED) {
+        return LOAD_BAD_IMAGE;
+    }
+    for (int i = 0; i < *numWords; i++) {
+        const unsigned char *b = bytes + 4 * i;
+        words[i] = (int)((unsigned int)b[0] | (unsigned int)b[1] << 8 |
+                         (unsigned int)b[2] << 16 | (unsigned int)b[3] << 24);
+    }
+    munmap((void *)bytes, (size_t)info.st_size);
+    return LOAD_OK;
+}
+
+// Read a machine-code file (hex text, or an image with -i) into words, which
+// holds MEMORYSIZE; the file is read in one piece rather than line by line
+static int loadProgram(const char *fileName, int *words, int *numWords)
+{
+    *numWords = 0;
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) {
+        return LOAD_CANT_OPEN;
+    }
+    if (imageInput) {
+        int status = loadImage(fd, words, numWords);
+        close(fd);
+        return status;
+    }
+
+    struct stat info;
+    size_t capacity = fstat(fd, &info) == 0 && info.st_size > 0 ? (size_t)info.st_size + 1 : 1 << 16;
+    size_t size = 0;
+    char *text = malloc(capacity);
+    ssize_t got;
+    while (text != NULL && (got = read(fd, text + size, capacity - size)) > 0) {
+        size += (size_t)got;
+        if (size == capacity) {
+            capacity *= 2;
+            char *grown = realloc(text, capacity);
+            if (grown == NULL) {
+                free(text);
+            }
+            text = grown;
+        }
+    }
+    close(fd);
+    if (text == NULL) {
+        fprintf(stderr, "error: out of memory reading %s\n", fileName);
+        exit(2);
+    }
+    int status = parseMachineCode(text, size, words, numWords);
+    free(text);
+    return status;
+}
+
+// Count the instruction about to run at pc: its opcode, the address it
+// loads or stores, and whether a beq will be taken
+static void profileStep(int pc, const int *reg, const int *mem)
+{
+    decodedType inst;
+    if (pc < 0 || pc >= MEMORYSIZE) {
+        return;
+    }
+    decodeInstruction(mem[pc], &inst);
+    profilePc[pc]++;
+    profileOpcodes[inst.opcode]++;
+    int address = reg[inst.regA] + inst.offset;
+    bool inBounds = address >= 0 && address < MEMORYSIZE;
+    if (inst.opcode == LW && inBounds) {
+        profileLoads[address]++;
+    } else if (inst.opcode == SW && inBounds) {
+        profileStores[address]++;
+    } else if (inst.opcode == BEQ) {
+        if (reg[inst.regA] == reg[inst.regB]) {
+            profileTaken[pc]++;
+        } else {
+            profileNotTaken[pc]++;
+        }
+    }
+}
+
+/*
+ * Checkpoint file: this header, then memory up to its last nonzero word, all
+ * in the host's byte order. Words past numMemory are kept because stores can
+ * put data there.
+ */
+#define CHECKPOINT_MAGIC "LC2KCKP1"
+
+typedef struct
+checkpointHeaderStruct {
+    char magic[8];
+    int32_t pc;
+    int32_t numMemory;
+    int32_t numInstructionsExecuted;
+    int32_t memoryWords;
+    int32_t reg[NUMREGS];
+} checkpointHeaderType;
+
+// Set the instruction count at which the next periodic checkpoint is due
+static void scheduleCheckpoint(int numInstructionsExecuted)
+{
+    if (checkpointEvery != 0) {
+        nextCheckpoint = (numInstructionsExecuted / checkpointEvery + 1) * checkpointEvery;
+    }
+}
+
+// Write the state as it is before its next instruction; a failed write
+// leaves the previous checkpoint in place and the run continues
+static void writeCheckpoint(stateType *statePtr)
+{
+    checkpointHeaderType header;
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.pc = statePtr->pc;
+    header.numMemory = statePtr->numMemory;
+    header.numInstructionsExecuted = statePtr->numInstructionsExecuted;
+    header.memoryWords = MEMORYSIZE;
+    while (header.memoryWords > 0 && statePtr->mem[header.memoryWords - 1] == 0) {
+        header.memoryWords--;
+    }
+    memcpy(header.reg, statePtr->reg, sizeof(header.reg));
+
+    checkpointRequested = 0;
+    scheduleCheckpoint(statePtr->numInstructionsExecuted);
+
+    FILE *filePtr = fopen(checkpointTempFile, "wb");
+    bool written = filePtr != NULL &&
+        fwrite(&header, sizeof(header), 1, filePtr) == 1 &&
+        fwrite(statePtr->mem, sizeof(int), (size_t)header.memoryWords, filePtr) ==
+            (size_t)header.memoryWords &&
+        fflush(filePtr) == 0 && fsync(fileno(filePtr)) == 0;
+    if (filePtr != NULL && fclose(filePtr) != 0) {
+        written = false;
+    }
+    if (!written || rename(checkpointTempFile, checkpointFile) != 0) {
+        fprintf(stderr, "warning: can't write checkpoint %s\n", checkpointFile);
+        remove(checkpointTempFile);
+    }
+}
+
+// Load the state saved by writeCheckpoint
+static void readCheckpoint(stateType *statePtr)
+{
+    checkpointHeaderType header;
+    FILE *filePtr = fopen(restoreFile, "rb");
+    if (filePtr == NULL) {
+        printf("error: can't open checkpoint %s\n", restoreFile);
+        exit(2);
+    }
+    if (fread(&header, sizeof(header), 1, filePtr) != 1 ||
+        memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.numMemory < 0 || header.numMemory > MEMORYSIZE ||
+        header.memoryWords < 0 || header.memoryWords > MEMORYSIZE ||
+        header.numInstructionsExecuted < 0 ||
+        fread(statePtr->mem, sizeof(int), (size_t)header.memoryWords, filePtr) !=
+            (size_t)header.memoryWords) {
+        printf("error: %s is not a valid checkpoint\n", restoreFile);
+        exit(2);
+    }
+    fclose(filePtr);
+    statePtr->pc = header.pc;
+    statePtr->numMemory = header.numMemory;
+    statePtr->numInstructionsExecuted = header.numInstructionsExecuted;
+    memcpy(statePtr->reg, header.reg, sizeof(header.reg));
+}
+
+static int compareSymbols(const void *a, const void *b)
+{
+    const symbolType *x = a, *y = b;
+    return (x->address > y->address) - (x->address < y->address);
+}
+
+// Read the "label address" lines the assembler writes as its symbol map
+static void readSymbols(const char *fileName)
+{
+    FILE *filePtr = fopen(fileName, "r");
+    if (filePtr == NULL) {
+        printf("error: can't open symbol file %s\n", fileName);
+        exit(1);
+    }
+    char name[MAXLINELENGTH];
+    int address;
+    int capacity = 0;
+    int fields;
+    while ((fields = fscanf(filePtr, "%999s %d", name, &address)) == 2) {
+        if (numSymbols == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            symbols = realloc(symbols, (size_t)capacity * sizeof(*symbols));
+            if (symbols == NULL) {
+                printf("error: out of memory reading %s\n", fileName);
+                exit(1);
+            }
+        }
+        symbols[numSymbols].address = address;
+        symbols[numSymbols].name = strdup(name);
+        numSymbols++;
+    }
+    if (fields != EOF) {
+        printf("error: malformed symbol file %s\n", fileName);
+        exit(1);
+    }
+    fclose(filePtr);
+    qsort(symbols, (size_t)numSymbols, sizeof(*symbols), compareSymbols);
+}
+
+// " label" or " label+offset" for the nearest symbol at or below address,
+// or "" without one
+static const char *symbolize(int address, char *buffer, size_t size)
+{
+    int low = 0;
+    int high = numSymbols;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (symbols[mid].address <= address) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    buffer[0] = '\0';
+    if (low > 0) {
+        symbolType *symbol = &symbols[low - 1];
+        if (symbol->address == address) {
+            snprintf(buffer, size, " %s", symbol->name);
+        } else {
+            snprintf(buffer, size, " %s+%d", symbol->name, address - symbol->address);
+        }
+    }
+    return buffer;
+}
+
+#define PROFILE_TOP 10  // Entries in each ranked list
+
+static const uint64_t *rankCounts;
+
+// Higher counts first, then lower addresses
+static int compareRanked(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    if (rankCounts[x] != rankCounts[y]) {
+        return rankCounts[x] < rankCounts[y] ? 1 : -1;
+    }
+    return x - y;
+}
+
+// Store the addresses with nonzero counts in ranked, highest count first,
+// and return how many of them to report
+static int rankAddresses(const uint64_t *counts, int *ranked)
+{
+    int numRanked = 0;
+    for (int i = 0; i < MEMORYSIZE; i++) {
+        if (counts[i] != 0) {
+            ranked[numRanked++] = i;
+        }
+    }
+    rankCounts = counts;
+    qsort(ranked, (size_t)numRanked, sizeof(*ranked), compareRanked);
+    return numRanked < PROFILE_TOP ? numRanked : PROFILE_TOP;
+}
+
+static void printRankedAccesses(const char *title, const uint64_t *counts, int *ranked)
+{
+    char label[MAXLINELENGTH];
+    int numRanked = rankAddresses(counts, ranked);
+    printf("\t%s:\n", title);
+    for (int i = 0; i < numRanked; i++) {
+        printf("\t\tmem[ %d ]%s: %" PRIu64 "\n", ranked[i],
+               symbolize(ranked[i], label, sizeof(label)), counts[ranked[i]]);
+    }
+}
+
+// Report where the run spent its instructions: opcode mix, hottest pcs,
+// loops closed by a backward beq, branch outcomes and busiest addresses
+static void printProfile(stateType *statePtr)
+{
+    static const char *opcodeNames[] = {"add", "nor", "lw", "sw", "beq", "jalr", "halt", "noop"};
+    static int ranked[MEMORYSIZE];
+    static uint64_t prefix[MEMORYSIZE + 1];     // prefix[i]: instructions run at pcs below i
+    static uint64_t loopInstructions[MEMORYSIZE];
+    char label[MAXLINELENGTH], endLabel[MAXLINELENGTH];
+    double total = statePtr->numInstructionsExecuted;
+
+    printf("profile:\n");
+    printf("\topcodes:\n");
+    for (int op = ADD; op <= NOOP; op++) {
+        printf("\t\t%s %" PRIu64 " (%.1f%%)\n", opcodeNames[op], profileOpcodes[op],
+               100.0 * (double)profileOpcodes[op] / total);
+    }
+
+    int numRanked = rankAddresses(profilePc, ranked);
+    printf("\thot spots:\n");
+    for (int i = 0; i < numRanked; i++) {
+        int pc = ranked[i];
+        printf("\t\tpc %d%s: %" PRIu64 " (%.1f%%)\n", pc, symbolize(pc, label, sizeof(label)),
+               profilePc[pc], 100.0 * (double)profilePc[pc] / total);
+    }
+
+    // A taken beq back to an earlier pc closes the loop [target, pc]; the
+    // instruction at pc is decoded again in case it was rewritten
+    for (int pc = 0; pc < MEMORYSIZE; pc++) {
+        prefix[pc + 1] = prefix[pc] + profilePc[pc];
+    }
+    for (int pc = 0; pc < MEMORYSIZE; pc++) {
+        decodedType inst;
+        decodeInstruction(statePtr->mem[pc], &inst);
+        int target = pc + 1 + inst.offset;
+        loopInstructions[pc] = 0;
+        if (profileTaken[pc] != 0 && inst.opcode == BEQ && target >= 0 && target <= pc) {
+            loopInstructions[pc] = prefix[pc + 1] - prefix[target];
+        }
+    }
+    numRanked = rankAddresses(loopInstructions, ranked);
+    printf("\thot loops:\n");
+    for (int i = 0; i < numRanked; i++) {
+        int pc = ranked[i];
+        decodedType inst;
+        decodeInstruction(statePtr->mem[pc], &inst);
+        int target = pc + 1 + inst.offset;
+        printf("\t\tpc %d%s to %d%s: %" PRIu64 " iterations, %" PRIu64 " instructions (%.1f%%)\n",
+               target, symbolize(target, label, sizeof(label)),
+               pc, symbolize(pc, endLabel, sizeof(endLabel)), profilePc[target],
+               loopInstructions[pc], 100.0 * (double)loopInstructions[pc] / total);
+    }
+
+    printf("\tbranches:\n");
+    for (int pc = 0; pc < MEMORYSIZE; pc++) {
+        if (profileTaken[pc] != 0 || profileNotTaken[pc] != 0) {
+            printf("\t\tpc %d%s: %" PRIu64 " taken, %" PRIu64 " not taken\n", pc,
+                   symbolize(pc, label, sizeof(label)), profileTaken[pc], profileNotTaken[pc]);
+        }
+    }
+
+    printRankedAccesses("loads", profileLoads, ranked);
+    printRankedAccesses("stores", profileStores, ranked);
+}
+
+// Parse SIZE:ASSOC:BLOCK:wb|wt[:LATENCY] into the next cache level
+static void addCacheLevel(const char *spec)
+{
+    if (numCacheLevels == CACHE_MAX_LEVELS) {
+        printf("error: at most %d cache levels\n", CACHE_MAX_LEVELS);
+        exit(1);
+    }
+    cacheLevelType *level = &cacheLevels[numCacheLevels];
+    char policy[3];
+    int consumed = 0;
+    level->latency = 1;
+    int fields = sscanf(spec, "%d:%d:%d:%2[a-z]%n:%d%n", &level->size, &level->associativity,
+                        &level->blockSize, policy, &consumed, &level->latency, &consumed);
+    if (fields < 4 || spec[consumed] != '\0' ||
+        (strcmp(policy, "wb") != 0 && strcmp(policy, "wt") != 0) ||
+        level->size < 1 || level->associativity < 1 || level->blockSize < 1 ||
+        level->latency < 0 || level->size % (level->associativity * level->blockSize) != 0) {
+        printf("error: cache level must be SIZE:ASSOC:BLOCK:wb|wt[:LATENCY], "
+               "with SIZE a multiple of ASSOC * BLOCK\n");
+        exit(1);
+    }
+    level->writeBack = strcmp(policy, "wb") == 0;
+    level->numSets = level->size / (level->associativity * level->blockSize);
+    level->lines = calloc((size_t)level->numSets * (size_t)level->associativity,
+                          sizeof(*level->lines));
+    if (level->lines == NULL) {
+        printf("error: out of memory\n");
+        exit(1);
+    }
+    numCacheLevels++;
+}
+
+// Access address at level levelIndex (numCacheLevels is memory) and return
+// the cycles it takes, including any levels below it
+static int cacheAccess(int levelIndex, int address, bool isWrite)
+{
+    if (levelIndex == numCacheLevels) {
+        if (isWrite) {
+            memoryWrites++;
+        } else {
+            memoryReads++;
+        }
+        return memoryLatency;
+    }
+
+    cacheLevelType *level = &cacheLevels[levelIndex];
+    int cycles = level->latency;
+    int block = address / level->blockSize;
+    cacheLineType *set = &level->lines[(size_t)(block % level->numSets) * (size_t)level->associativity];
+    cacheLineType *victim = &set[0];
+    level->clock++;
+
+    for (int way = 0; way < level->associativity; way++) {
+        cacheLineType *line = &set[way];
+        if (line->valid && line->block == block) {
+            level->hits++;
+            line->lastUsed = level->clock;
+            if (isWrite) {
+                if (level->writeBack) {
+                    line->dirty = true;
+                } else {
+                    cycles += cacheAccess(levelIndex + 1, address, true);
+                }
+            }
+            return cycles;
+        }
+        if (victim->valid && (!line->valid || line->lastUsed < victim->lastUsed)) {
+            victim = line;
+        }
+    }
+
+    level->misses++;
+    if (isWrite && !level->writeBack) {
+        return cycles + cacheAccess(levelIndex + 1, address, true);
+    }
+    cycles += cacheAccess(levelIndex + 1, address, false);
+    if (victim->valid) {
+        level->evictions++;
+        if (victim->dirty) {
+            level->writebacks++;
+            cycles += cacheAccess(levelIndex + 1, victim->block * level->blockSize, true);
+        }
+    }
+    victim->block = block;
+    victim->valid = true;
+    victim->dirty = isWrite;
+    victim->lastUsed = level->clock;
+    return cycles;
+}
+
+// Send the lw or sw about to run at pc through the hierarchy. Accesses out
+// of bounds are left for the interpreter to report.
+static void cacheStep(int pc, const int *reg, const int *mem)
+{
+    decodedType inst;
+    if (pc < 0 || pc >= MEMORYSIZE) {
+        return;
+    }
+    decodeInstruction(mem[pc], &inst);
+    int address = reg[inst.regA] + inst.offset;
+    if ((inst.opcode == LW || inst.opcode == SW) && address >= 0 && address < MEMORYSIZE) {
+        dataCycles += (uint64_t)cacheAccess(0, address, inst.opcode == SW);
+    }
+}
+
+// Per-level counts and a cycle estimate: one cycle per instruction plus the
+// time spent in data accesses
+static void printCacheReport(stateType *statePtr)
+{
+    printf("cache:\n");
+    for (int i = 0; i < numCacheLevels; i++) {
+        cacheLevelType *level = &cacheLevels[i];
+        uint64_t accesses = level->hits + level->misses;
+        printf("\tL%d %d words, %d-way, %d-word blocks, %s, %d cycles:\n", i + 1,
+               level->size, level->associativity, level->blockSize,
+               level->writeBack ? "write-back" : "write-through", level->latency);
+        printf("\t\t%" PRIu64 " accesses, %" PRIu64 " hits, %" PRIu64 " misses (%.1f%%), "
+               "%" PRIu64 " evictions, %" PRIu64 " writebacks\n",
+               accesses, level->hits, level->misses,
+               accesses ? 100.0 * (double)level->misses / (double)accesses : 0.0,
+               level->evictions, level->writebacks);
+    }
+    printf("\tmemory %d cycles: %" PRIu64 " reads, %" PRIu64 " writes\n",
+           memoryLatency, memoryReads, memoryWrites);
+    printf("\testimated cycles: %" PRIu64 " (%d instructions, %" PRIu64 " in data accesses)\n",
+           (uint64_t)statePtr->numInstructionsExecuted + dataCycles,
+           statePtr->numInstructionsExecuted, dataCycles);
+}
+
+/*
+ * Batch runner. Each program runs in a forked child whose stdout is its
+ * output file (or a temporary file, for the ordered stream), through the
+ * same loadMachineCode, execute and printState as a single run, so the
+ * output and exit code are exactly those of a single run. Messages a single
+ * run sends to stderr go to the runner's stderr. The child's stateType is
+ * calloc'd: memory a small program never touches is never made resident.
+ */
+typedef struct
+batchJobStruct {
+    char *fileName;
+    pid_t pid;
+    FILE *out;              // Temporary output file in stream mode
+    char *output;           // Its contents once the job is done
+    size_t outputSize;
+    int status;             // The exit code of the run
+    bool done;
+} batchJobType;
+
+static batchJobType *batchJobs;
+static int numBatchJobs;
+
+static const char *baseName(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash == NULL ? path : slash + 1;
+}
+
+// Fork a child that runs the job's program with stdout sent to its output
+static void startBatchJob(batchJobType *job)
+{
+    FILE *out;
+    if (batchOutputDir != NULL) {
+        const char *name = baseName(job->fileName);
+        char *outputPath = malloc(strlen(batchOutputDir) + strlen(name) + sizeof("/.out"));
+        if (outputPath == NULL) {
+            fprintf(stderr, "error: out of memory\n");
+            exit(1);
+        }
+        sprintf(outputPath, "%s/%s.out", batchOutputDir, name);
+        out = fopen(outputPath, "w");
+        free(outputPath);
+    } else {
+        out = tmpfile();
+    }
+    if (out == NULL) {
+        fprintf(stderr, "error: can't open output for %s\n", job->fileName);
+        exit(1);
+    }
+
+    fflush(stdout);
+    job->pid = fork();
+    if (job->pid < 0) {
+        fprintf(stderr, "error: can't start a job for %s\n", job->fileName);
+        exit(1);
+    }
+    if (job->pid == 0) {
+        dup2(fileno(out), STDOUT_FILENO);
+        fclose(out);
+        stateType *statePtr = calloc(1, sizeof(stateType));
+        if (statePtr == NULL) {
+            fprintf(stderr, "error: out of memory\n");
+            exit(1);
+        }
+        loadMachineCode(job->fileName, statePtr);
+        runMachine(statePtr);
+        exit(0);
+    }
+
+    if (batchOutputDir != NULL) {
+        fclose(out);
+    } else {
+        job->out = out;
+    }
+}
+
+// Record how the job's child ended and, in stream mode, collect its output
+static void finishBatchJob(batchJobType *job, int waitStatus)
+{
+    job->status = WIFEXITED(waitStatus) ? WEXITSTATUS(waitStatus) : 128 + WTERMSIG(waitStatus);
+    job->done = true;
+    if (job->out == NULL) {
+        return;
+    }
+    fseek(job->out, 0, SEEK_END);
+    long size = ftell(job->out);
+    rewind(job->out);
+    job->output = malloc(size > 0 ? (size_t)size : 1);
+    if (size < 0 || job->output == NULL) {
+        fprintf(stderr, "error: can't read the output of %s\n", job->fileName);
+        exit(1);
+    }
+    job->outputSize = fread(job->output, 1, (size_t)size, job->out);
+    fclose(job->out);
+    job->out = NULL;
+}
+
+// Run the programs in batchFile and return the highest exit code among them
+static int runBatch(void)
+{
+    FILE *listPtr = fopen(batchFile, "r");
+    if (listPtr == NULL) {
+        printf("error: can't open program list %s\n", batchFile);
+        exit(2);
+    }
+    char line[MAXLINELENGTH];
+    int capacity = 0;
+    while (fgets(line, MAXLINELENGTH, listPtr) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') {
+            continue;
+        }
+        if (numBatchJobs == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            batchJobs = realloc(batchJobs, (size_t)capacity * sizeof(*batchJobs));
+            if (batchJobs == NULL) {
+                printf("error: out of memory\n");
+                exit(1);
+            }
+        }
+        memset(&batchJobs[numBatchJobs], 0, sizeof(*batchJobs));
+        batchJobs[numBatchJobs].fileName = strdup(line);
+        numBatchJobs++;
+    }
+    fclose(listPtr);
+
+    // Output files are named after the programs, so the names must differ
+    if (batchOutputDir != NULL) {
+        for (int i = 0; i < numBatchJobs; i++) {
+            for (int j = 0; j < i; j++) {
+                if (strcmp(baseName(batchJobs[i].fileName), baseName(batchJobs[j].fileName)) == 0) {
+                    printf("error: %s and %s would share an output file\n",
+                           batchJobs[j].fileName, batchJobs[i].fileName);
+                    exit(1);
+                }
+            }
+        }
+    }
+
+    int jobLimit = batchJobLimit;
+    if (jobLimit == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobLimit = cpus > 0 ? (int)cpus : 1;
+    }
+
+    // Keep jobLimit children running, and stream each output as soon as it
+    // and every one before it are done
+    int nextJob = 0, running = 0, worst = 0;
+    for (int i = 0; i < numBatchJobs; i++) {
+        batchJobType *job = &batchJobs[i];
+        while (!job->done) {
+            while (running < jobLimit && nextJob < numBatchJobs) {
+                startBatchJob(&batchJobs[nextJob++]);
+                running++;
+            }
+            int waitStatus;
+            pid_t pid = wait(&waitStatus);
+            if (pid < 0) {
+                fprintf(stderr, "error: lost track of a job\n");
+                exit(1);
+            }
+            for (int j = i; j < nextJob; j++) {
+                if (batchJobs[j].pid == pid && !batchJobs[j].done) {
+                    finishBatchJob(&batchJobs[j], waitStatus);
+                    running--;
+                    break;
+                }
+            }
+        }
+        if (batchOutputDir == NULL) {
+            printf("==> %s <==\n", job->fileName);
+            fwrite(job->output, 1, job->outputSize, stdout);
+            free(job->output);
+        }
+        if (job->status != 0) {
+            fflush(stdout);
+            fprintf(stderr, "%s: exit %d\n", job->fileName, job->status);
+        }
+        if (job->status > worst) {
+            worst = job->status;
+        }
+    }
+    fflush(stdout);
+    return worst;
+}
+
+#ifdef JIT_AVAILABLE
+/*
+ * Basic-block JIT. A block is a run of add, nor, lw, sw and noop ending in a
+ * beq or jalr (or cut short by a halt or the length cap), compiled once its
+ * start has been reached JIT_HOT_THRESHOLD times. Compiled code is called as
+ *
+ *     int block(int *reg, int *mem, jitExitType *exit, uint8_t *covered,
+ *               decodedType *decoded)       // rdi, rsi, rdx, rcx, r8
+ *
+ * and returns the next pc, having added the instructions it ran to
+ * exit->executed. Loads and stores out of bounds leave the block just before
+ * the faulting instruction with exit->fault set so the interpreter reports
+ * the error; a store into a compiled word leaves just after itself with
+ * exit->flush set, and all code is discarded. Exits to a fixed pc are patchable: once the target is
+ * compiled, the dispatcher rewrites the exit into a direct jump, and each
+ * block entry spends one unit of exit->budget so chained code still returns.
+ */
+#define JIT_CODE_SIZE (16 << 20)
+#define JIT_MAX_BLOCK 64
+#define JIT_MAX_BLOCK_BYTES (JIT_MAX_BLOCK * 64 + 128)
+#define JIT_HOT_THRESHOLD 8
+#define JIT_BUDGET (1 << 16)
+#define JIT_FLUSH 8             // Offsets of the exit flags below
+#define JIT_FAULT 12
+
+typedef struct
+jitExitStruct {
+    int32_t executed;    // +0
+    int32_t budget;      // +4
+    int32_t flush;       // +8: a store hit compiled code
+    int32_t fault;       // +12: stopped before an out-of-bounds access
+    uint8_t *chainSlot;  // +16: patchable exit taken, or NULL
+} jitExitType;
+
+typedef int (*jitBlockFn)(int *, int *, jitExitType *, uint8_t *, decodedType *);
+
+static uint8_t *jitCode;      // JIT_CODE_SIZE bytes, or NULL if unavailable
+static size_t jitCodeUsed;
+static uint8_t *jitBlocks[MEMORYSIZE];  // Entry of the block starting at each pc
+static uint8_t jitHeat[MEMORYSIZE];
+static uint8_t *jitOut;       // Emission point
+
+static void emit8(int byte) { *jitOut++ = (uint8_t)byte; }
+
+static void emit32(int32_t value)
+{
+    memcpy(jitOut, &value, sizeof(value));
+    jitOut += sizeof(value);
+}
+
+// op [rdi + 4*r] forms for the LC-2K register file
+static void emitRegOp(int prefix, int op, int hostReg, int lcReg)
+{
+    if (prefix) {
+        emit8(prefix);
+    }
+    emit8(op);
+    emit8(0x40 | (hostReg << 3) | 7);
+    emit8(lcReg * 4);
+}
+
+// Leave the block: count the instructions run, return nextPc and set the
+// exit flag at flagOffset, if any. A chainable exit records its slot so the
+// dispatcher can patch it into a jump.
+static void emitExit(int executed, int nextPc, bool chainable, int flagOffset)
+{
+    emit8(0x81); emit8(0x02); emit32(executed);          // add dword [rdx], executed
+    if (flagOffset) {
+        emit8(0xC7); emit8(0x42); emit8(flagOffset); emit32(1); // mov dword [rdx+flag], 1
+    }
+    if (chainable) {
+        uint8_t *slot = jitOut;
+        emit8(0xB8); emit32(nextPc);                      // mov eax, nextPc (patched to jmp)
+        emit8(0x49); emit8(0xB9);                         // mov r9, slot
+        memcpy(jitOut, &slot, sizeof(slot));
+        jitOut += sizeof(slot);
+        emit8(0x4C); emit8(0x89); emit8(0x4A); emit8(0x10); // mov [rdx+16], r9
+    } else {
+        emit8(0xB8); emit32(nextPc);                      // mov eax, nextPc
+        emit8(0x48); emit8(0xC7); emit8(0x42); emit8(0x10); emit32(0); // mov qword [rdx+16], 0
+    }
+    emit8(0xC3);                                          // ret
+}
+
+// Start a forward jcc rel8 whose target is fixed by jitPatchJump
+static uint8_t *emitJumpRel8(int opcode)
+{
+    emit8(opcode);
+    emit8(0);
+    return jitOut;
+}
+
+static void jitPatchJump(uint8_t *after)
+{
+    after[-1] = (uint8_t)(jitOut - after);
+}
+
+// eax = reg[regA] + offset, leaving the block unless 0 <= eax < MEMORYSIZE
+static void emitAddress(decodedType *inst, int executed, int pc)
+{
+    emitRegOp(0, 0x8B, 0, inst->regA);                    // mov eax, reg[regA]
+    emit8(0x05); emit32(inst->offset);                    // add eax, offset
+    emit8(0x3D); emit32(MEMORYSIZE - 1);                  // cmp eax, MEMORYSIZE - 1
+    uint8_t *inBounds = emitJumpRel8(0x76);               // jbe inBounds
+    emitExit(executed, pc, false, JIT_FAULT);
+    jitPatchJump(inBounds);
+}
+
+void jitFlush(void)
+{
+    jitCodeUsed = 0;
+    memset(jitBlocks, 0, sizeof(jitBlocks));
+    memset(jitCovered, 0, sizeof(jitCovered));
+    memset(jitHeat, 0, sizeof(jitHeat));
+}
+
+// Compile the block starting at pc and return its entry
+static uint8_t *jitCompile(stateType *statePtr, int pc)
+{
+    if (jitCodeUsed + JIT_MAX_BLOCK_BYTES > JIT_CODE_SIZE) {
+        jitFlush();
+    }
+    uint8_t *entry = jitCode + jitCodeUsed;
+    jitOut = entry;
+
+    // Spend one unit of budget per entry; when it runs out, return to the dispatcher
+    emit8(0xFF); emit8(0x4A); emit8(0x04);                // dec dword [rdx+4]
+    uint8_t *hasBudget = emitJumpRel8(0x79);              // jns hasBudget
+    emitExit(0, pc, false, 0);
+    jitPatchJump(hasBudget);
+
+    int executed = 0;
+    int current = pc;
+    bool ended = false;
+    while (!ended && current < MEMORYSIZE && executed < JIT_MAX_BLOCK) {
+        decodedType inst;
+        decodeInstruction(statePtr->mem[current], &inst);
+        if (inst.opcode == HALT) {
+            break;
+        }
+        jitCovered[current] = 1;
+        switch (inst.opcode) {
+            case ADD:
+            case NOR:
+                emitRegOp(0, 0x8B, 0, inst.regA);         // mov eax, reg[regA]
+                if (inst.opcode == ADD) {
+                    emitRegOp(0, 0x03, 0, inst.regB);     // add eax, reg[regB]
+                } else {
+                    emitRegOp(0, 0x0B, 0, inst.regB);     // or eax, reg[regB]
+                    emit8(0xF7); emit8(0xD0);             // not eax
+                }
+                emitRegOp(0, 0x89, 0, inst.destReg);      // mov reg[destReg], eax
+                break;
+            case LW:
+                emitAddress(&inst, executed, current);
+                emit8(0x8B); emit8(0x04); emit8(0x86);    // mov eax, [rsi + rax*4]
+                emitRegOp(0, 0x89, 0, inst.regB);         // mov reg[regB], eax
+                break;
+            case SW:
+                emitAddress(&inst, executed, current);
+                emitRegOp(0x44, 0x8B, 2, inst.regB);      // mov r10d, reg[regB]
+                emit8(0x44); emit8(0x89); emit8(0x14); emit8(0x86); // mov [rsi + rax*4], r10d
+                emit8(0x41); emit8(0xC6); emit8(0x04); emit8(0xC0); emit8(DECODE); // mov byte [r8 + rax*8], DECODE
+                emit8(0x80); emit8(0x3C); emit8(0x01); emit8(0x00); // cmp byte [rcx + rax], 0
+                {
+                    uint8_t *notCode = emitJumpRel8(0x74); // je notCode
+                    emitExit(executed + 1, current + 1, false, JIT_FLUSH);
+                    jitPatchJump(notCode);
+                }
+                break;
+            case BEQ:
+                emitRegOp(0, 0x8B, 0, inst.regA);         // mov eax, reg[regA]
+                emitRegOp(0, 0x3B, 0, inst.regB);         // cmp eax, reg[regB]
+                {
+                    uint8_t *taken = emitJumpRel8(0x74);  // je taken
+                    emitExit(executed + 1, current + 1, true, 0);
+                    jitPatchJump(taken);
+                    emitExit(executed + 1, current + 1 + inst.offset, true, 0);
+                }
+                ended = true;
+                break;
+            case JALR:
+                emit8(0xC7); emit8(0x47); emit8(inst.regB * 4); emit32(current + 1); // mov reg[regB], pc + 1
+                emitRegOp(0, 0x8B, 0, inst.regA);         // mov eax, reg[regA]
+                emit8(0x81); emit8(0x02); emit32(executed + 1); // add dword [rdx], executed
+                emit8(0x48); emit8(0xC7); emit8(0x42); emit8(0x10); emit32(0); // mov qword [rdx+16], 0
+                emit8(0xC3);                              // ret
+                ended = true;
+                break;
+            case NOOP:
+                break;
+        }
+        executed++;
+        current++;
+    }
+    if (!ended) {
+        emitExit(executed, current, true, 0);
+    }
+
+    jitCodeUsed = (size_t)(jitOut - jitCode);
+    jitBlocks[pc] = entry;
+    return entry;
+}
+
+// Run compiled blocks where they exist and interpret cold ones a block at a
+// time; only returns if no code memory can be mapped
+static void executeJit(stateType *statePtr)
+{
+    void *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        fprintf(stderr, "note: cannot map JIT code memory, interpreting instead\n");
+        return;
+    }
+    jitCode = code;
+
+    jitExitType jitExit;
+    while (1) {
+        int pc = statePtr->pc;
+        uint8_t *entry = NULL;
+        if (pc >= 0 && pc < MEMORYSIZE) {
+            entry = jitBlocks[pc];
+            if (entry == NULL && ++jitHeat[pc] >= JIT_HOT_THRESHOLD) {
+                entry = jitCompile(statePtr, pc);
+            }
+        }
+        if (entry == NULL) {
+            execute(statePtr, true);
+            continue;
+        }
+
+        jitBlockFn block;
+        memcpy(&block, &entry, sizeof(block));
+        jitExit.executed = 0;
+        jitExit.budget = JIT_BUDGET;
+        jitExit.flush = 0;
+        jitExit.fault = 0;
+        jitExit.chainSlot = NULL;
+        statePtr->pc = block(statePtr->reg, statePtr->mem, &jitExit, jitCovered, decoded);
+        statePtr->numInstructionsExecuted += jitExit.executed;
+
+        if (jitExit.fault) {
+            // Let the interpreter report it
+            execute(statePtr, true);
+        } else if (jitExit.flush) {
+            jitFlush();
+        } else if (jitExit.chainSlot != NULL && statePtr->pc >= 0 && statePtr->pc < MEMORYSIZE &&
+                   jitBlocks[statePtr->pc] != NULL) {
+            // Jump straight to the target block from now on
+            uint8_t *slot = jitExit.chainSlot;
+            int32_t distance = (int32_t)(jitBlocks[statePtr->pc] - (slot + 5));
+            slot[0] = 0xE9;                               // jmp target
+            memcpy(slot + 1, &distance, sizeof(distance));
+        }
+    }
+}
+#endif
@@ -0,0 +1,1472 @@
+// Project Identifier: 50EB44D3F029ED934858FFFCEAC3547C68251FC9
+
+#include "word_graph.h"
+
+#include <cstdio>
+#include <cstdlib>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <new>
+#include <utility>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+using namespace std;
+
+#ifdef DEBUG
+// Per-thread heap allocation counter, used to check that the search loop does not allocate
+thread_local size_t allocation_count = 0;
+
+// Counts and performs every replaced allocation; over-aligned requests go to
+// aligned_alloc, whose size must be a multiple of the alignment
+static void* counted_alloc(size_t size, size_t alignment) noexcept {
+    ++allocation_count;
+    if (alignment <= alignof(max_align_t)) {
+        return malloc(size ? size : 1);
+    }
+    size_t rounded = size ? (size + alignment - 1) / alignment * alignment : alignment;
+    return aligned_alloc(alignment, rounded);
+}
+static void* counted_alloc_or_throw(size_t size, size_t alignment) {
+    if (void* ptr = counted_alloc(size, alignment)) {
+        return ptr;
+    }
+    throw bad_alloc();
+}
+
+void* operator new(size_t size) { return counted_alloc_or_throw(size, 0); }
+void* operator new[](size_t size) { return counted_alloc_or_throw(size, 0); }
+void* operator new(size_t size, align_val_t align) {
+    return counted_alloc_or_throw(size, static_cast<size_t>(align));
+}
+void* operator new[](size_t size, align_val_t align) {
+    return counted_alloc_or_throw(size, static_cast<size_t>(align));
+}
+void* operator new(size_t size, const nothrow_t&) noexcept { return counted_alloc(size, 0); }
+void* operator new[](size_t size, const nothrow_t&) noexcept { return counted_alloc(size, 0); }
+void* operator new(size_t size, align_val_t align, const nothrow_t&) noexcept {
+    return counted_alloc(size, static_cast<size_t>(align));
+}
+void* operator new[](size_t size, align_val_t align, const nothrow_t&) noexcept {
+    return counted_alloc(size, static_cast<size_t>(align));
+}
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+void operator delete(void* ptr, align_val_t) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t, align_val_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, align_val_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t, align_val_t) noexcept { free(ptr); }
+
+// Asserts on scope exit that nothing was allocated since construction
+struct NoAllocationScope {
+    size_t allocations_before;
+    NoAllocationScope() : allocations_before(allocation_count) {}
+    ~NoAllocationScope() { assert(allocation_count == allocations_before); }
+};
+#else
+struct NoAllocationScope {
+    NoAllocationScope() {}
+};
+#endif
+
+void process_complex_word(const string& word, vector<string> &words) {
+
+    // Check for reversal (&)
+    if (word.back() == '&') {
+        string base = word.substr(0, word.length() - 1);
+        words.push_back(base);
+        string reversed = base;
+        reverse(reversed.begin(), reversed.end());
+        words.push_back(reversed);
+        return;
+    }
+
+    // Check for insert-each ([])
+    size_t open_bracket = word.find('[');
+    if (open_bracket != string::npos) {
+        size_t close_bracket = word.find(']');
+        string prefix = word.substr(0, open_bracket);
+        string suffix = word.substr(close_bracket + 1);
+        string chars = word.substr(open_bracket + 1, close_bracket - open_bracket - 1);
+
+        for (size_t i = 0; i < chars.length(); ++i) {
+            words.push_back(prefix + chars[i] + suffix);
+        }
+        return;
+    }
+
+    // Check for swap (!)
+    size_t exclamation = word.find('!');
+    if (exclamation != string::npos && exclamation >= 2) {
+        string base = word.substr(0, exclamation) + word.substr(exclamation + 1);
+        words.push_back(base);
+
+        // Create swapped version
+        string swapped = base;
+        swap(swapped[exclamation - 2], swapped[exclamation - 1]);
+        words.push_back(swapped);
+        return;
+    }
+
+    // Check for double (?)
+    size_t question = word.find('?');
+    if (question != string::npos && question >= 1) {
+        string base = word.substr(0, question) + word.substr(question + 1);
+        words.push_back(base);
+
+        // Create doubled version
+        string doubled = word.substr(0, question) + word[question - 1] + word.substr(question + 1);
+        words.push_back(doubled);
+        return;
+    }
+
+    // No special characters, just return the word as-is
+    words.push_back(word);
+}
+
+DictionaryReader::DictionaryReader(istream &in) : in(in) {
+    in >> dict_type;
+    in >> lines_left;
+
+    string line;
+    // Clear the newline after the number
+    getline(in, line);
+}
+
+bool DictionaryReader::read(vector<string> &words, size_t max_lines) {
+    string line;
+    for (size_t read_lines = 0; lines_left > 0 && read_lines < max_lines; ) {
+        if (!getline(in, line)) {
+            lines_left = 0;
+            break;
+        }
+
+        // Skip empty lines
+        if (line.empty()) {
+            continue;
+        }
+
+        // Skip comment lines
+        if (line.length() >= 2 && line[0] == '/' && line[1] == '/') {
+            continue;
+        }
+
+        if (dict_type == 'S') {
+            // Simple dictionary
+            words.push_back(line);
+        } else if (dict_type == 'C') {
+            // Complex dictionary: process the line and add all generated words
+            process_complex_word(line, words);
+        }
+        --lines_left;
+        ++read_lines;
+    }
+    if (lines_left > 0) {
+        return true;
+    }
+
+    // Continue reading any remaining lines (comments or empty lines at end)
+    while (getline(in, line)) {
+        // Just consume and ignore
+    }
+    return false;
+}
+
+void read_dictionary(istream &in, vector<string> &words) {
+    DictionaryReader reader(in);
+    reader.read(words, static_cast<size_t>(-1));
+}
+
+void FrontCodedDictionary::append(const string &word) {
+    if (num_words % BLOCK_SIZE == 0) {
+        // Block head: stored whole
+        block_offsets.push_back(data.size());
+        append_varint(word.length());
+        data.insert(data.end(), word.begin(), word.end());
+    } else {
+        // Shared prefix length with the previous word, then the rest
+        size_t shared = 0;
+        while (shared < previous.length() && shared < word.length() && previous[shared] == word[shared]) {
+            ++shared;
+        }
+        append_varint(shared);
+        append_varint(word.length() - shared);
+        data.insert(data.end(), word.begin() + static_cast<ptrdiff_t>(shared), word.end());
+    }
+    previous = word;
+    ++num_words;
+}
+
+void FrontCodedDictionary::finish() {
+    data.shrink_to_fit();
+    block_offsets.shrink_to_fit();
+    string().swap(previous);
+}
+
+size_t FrontCodedDictionary::memory_usage() const {
+    return data.capacity() + block_offsets.capacity() * sizeof(size_t);
+}
+
+void FrontCodedDictionary::append_varint(size_t value) {
+    while (value >= 0x80) {
+        data.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    data.push_back(static_cast<unsigned char>(value));
+}
+
+size_t FrontCodedDictionary::read_varint(const unsigned char *&ptr) {
+    size_t value = 0;
+    for (unsigned shift = 0; ; shift += 7) {
+        unsigned char byte = *ptr++;
+        value |= static_cast<size_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+}
+
+// Length of the common prefix of two byte ranges
+static inline size_t common_prefix(const unsigned char *a, size_t a_length, const unsigned char *b, size_t b_length) {
+    size_t length = min(a_length, b_length);
+    size_t shared = 0;
+    while (shared < length && a[shared] == b[shared]) {
+        ++shared;
+    }
+    return shared;
+}
+
+int FrontCodedDictionary::find(const string &word) const {
+    const unsigned char *target = reinterpret_cast<const unsigned char *>(word.data());
+    size_t target_length = word.length();
+    
+    // Binary search the block heads for the last block starting at or before word
+    size_t left = 0;
+    size_t right = block_offsets.size();
+    while (left < right) {
+        size_t mid = left + (right - left) / 2;
+        const unsigned char *ptr = &data[block_offsets[mid]];
+        size_t length = read_varint(ptr);
+        size_t shared = common_prefix(ptr, length, target, target_length);
+        bool head_after_word = shared == target_length ? length > target_length
+                             : shared < length && ptr[shared] > target[shared];
+        if (head_after_word) {
+            right = mid;
+        } else {
+            left = mid + 1;
+        }
+    }
+    if (left == 0) {
+        return -1;
+    }
+    size_t block = left - 1;
+    
+    // Scan the block. matched is the prefix the current word shares with the
+    // target, which sorts after the current word; entries that share more with
+    // their predecessor are still smaller, and entries that share less are
+    // already larger, so only entries sharing exactly matched need comparing.
+    const unsigned char *ptr = &data[block_offsets[block]];
+    size_t length = read_varint(ptr);
+    size_t matched = common_prefix(ptr, length, target, target_length);
+    if (matched == length && matched == target_length) {
+        return static_cast<int>(block * BLOCK_SIZE);
+    }
+    ptr += length;
+    
+    size_t end = min(num_words, (block + 1) * BLOCK_SIZE);
+    for (size_t id = block * BLOCK_SIZE + 1; id < end; ++id) {
+        size_t shared = read_varint(ptr);
+        size_t suffix_length = read_varint(ptr);
+        const unsigned char *suffix = ptr;
+        ptr += suffix_length;
+        
+        if (shared > matched) {
+            continue;
+        }
+        if (shared < matched) {
+            return -1;
+        }
+        size_t extra = common_prefix(suffix, suffix_length, target + matched, target_length - matched);
+        matched += extra;
+        if (extra == suffix_length) {
+            if (matched == target_length) {
+                return static_cast<int>(id);
+            }
+            continue; // Entry is a proper prefix of the target
+        }
+        if (matched == target_length || suffix[extra] > target[matched]) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+void FrontCodedDictionary::decode(int word_id, string &out) const {
+    size_t id = static_cast<size_t>(word_id);
+    size_t block = id / BLOCK_SIZE;
+    const unsigned char *ptr = &data[block_offsets[block]];
+    size_t length = read_varint(ptr);
+    out.assign(reinterpret_cast<const char *>(ptr), length);
+    ptr += length;
+    for (size_t i = block * BLOCK_SIZE; i < id; ++i) {
+        size_t shared = read_varint(ptr);
+        size_t suffix_length = read_varint(ptr);
+        out.resize(shared);
+        out.append(reinterpret_cast<const char *>(ptr), suffix_length);
+        ptr += suffix_length;
+    }
+}
+
+BlockedBloomFilter::BlockedBloomFilter(size_t expected_words, size_t max_bytes) {
+    size_t num_blocks = min((expected_words * BITS_PER_WORD + 511) / 512, max_bytes / sizeof(Block));
+    blocks.assign(max<size_t>(num_blocks, 1), Block());
+}
+
+void BlockedBloomFilter::add(const string &word) {
+    uint64_t hash = hash_word(word);
+    Block &block = blocks[((hash >> 32) * blocks.size()) >> 32];
+    uint64_t bit_hash = mix(hash);
+    for (unsigned j = 0; j < NUM_PROBES; ++j, bit_hash >>= 9) {
+        unsigned bit = static_cast<unsigned>(bit_hash & 511);
+        block.bits[bit >> 6] |= uint64_t(1) << (bit & 63);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (address != nullptr) {
+        munmap(address, length);
+    }
+}
+
+int MappedFile::create_temp_file() {
+    const char *directory = getenv("TMPDIR");
+    string path = string(directory != nullptr && *directory != '\0' ? directory : "/tmp") + "/letter-XXXXXX";
+    int fd = mkstemp(&path[0]);
+    if (fd == -1) {
+        cerr << "Error: Cannot create temporary file in " << path.substr(0, path.length() - 14) << "\n";
+        exit(1);
+    }
+    unlink(path.c_str());
+    return fd;
+}
+
+void MappedFile::map(int fd, size_t bytes) {
+    assert(address == nullptr);
+    if (bytes != 0) {
+        void *mapped = MAP_FAILED;
+        if (ftruncate(fd, static_cast<off_t>(bytes)) == 0) {
+            mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (mapped == MAP_FAILED) {
+            cerr << "Error: Cannot map " << bytes << " bytes of temporary file\n";
+            exit(1);
+        }
+        address = mapped;
+        length = bytes;
+    }
+    close(fd);
+}
+
+void MappedFile::create(size_t bytes) {
+    map(create_temp_file(), bytes);
+}
+
+void MappedFile::release_pages(size_t offset, size_t bytes) const {
+    // Whole pages only; madvise needs a page-aligned start
+    static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t begin = (offset + page_size - 1) / page_size * page_size;
+    size_t end = min(offset + bytes, length) / page_size * page_size;
+    if (address != nullptr && begin < end) {
+        madvise(static_cast<char *>(address) + begin, end - begin, MADV_DONTNEED);
+    }
+}
+
+// Buffered sequential writer for a temporary file
+class TempFileWriter {
+public:
+    TempFileWriter() : fd(MappedFile::create_temp_file()) { buffer.reserve(BUFFER_SIZE); }
+
+    void append(const void *bytes, size_t count) {
+        const char *data = static_cast<const char *>(bytes);
+        buffer.insert(buffer.end(), data, data + count);
+        written += count;
+        if (buffer.size() >= BUFFER_SIZE) {
+            flush();
+        }
+    }
+
+    // Flush and hand over the descriptor, positioned at the start of the file
+    int finish() {
+        flush();
+        lseek(fd, 0, SEEK_SET);
+        return fd;
+    }
+
+    size_t size() const { return written; }
+
+private:
+    static const size_t BUFFER_SIZE = 1 << 16;
+
+    int fd;
+    vector<char> buffer;
+    size_t written = 0;
+
+    void flush() {
+        for (size_t done = 0; done < buffer.size(); ) {
+            ssize_t result = write(fd, buffer.data() + done, buffer.size() - done);
+            if (result <= 0) {
+                cerr << "Error: Cannot write temporary file\n";
+                exit(1);
+            }
+            done += static_cast<size_t>(result);
+        }
+        buffer.clear();
+    }
+};
+
+// One sorted run of (word, input position) pairs in a temporary file
+class SortedRun {
+public:
+    explicit SortedRun(int fd) : file(fdopen(fd, "rb")) {}
+    ~SortedRun() { fclose(file); }
+    SortedRun(const SortedRun &) = delete;
+    SortedRun& operator=(const SortedRun &) = delete;
+
+    static int write(const vector<pair<string, int> > &entries) {
+        TempFileWriter writer;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            uint32_t length = static_cast<uint32_t>(entries[i].first.length());
+            writer.append(&length, sizeof(length));
+            writer.append(entries[i].first.data(), length);
+            writer.append(&entries[i].second, sizeof(int));
+        }
+        return writer.finish();
+    }
+
+    // Next entry, or false at the end of the run
+    bool next(pair<string, int> &entry) {
+        uint32_t length;
+        if (fread(&length, sizeof(length), 1, file) != 1) {
+            return false;
+        }
+        entry.first.resize(length);
+        if ((length != 0 && fread(&entry.first[0], length, 1, file) != 1) ||
+            fread(&entry.second, sizeof(int), 1, file) != 1) {
+            cerr << "Error: Cannot read temporary file\n";
+            exit(1);
+        }
+        return true;
+    }
+
+private:
+    FILE *file;
+};
+
+WordGraph::WordGraph(vector<string> words, const WordGraphOptions &options) {
+    build_in_memory(std::move(words), options);
+}
+
+WordGraph::WordGraph(DictionaryReader &reader, const WordGraphOptions &options) {
+    if (options.memory_limit != 0) {
+        memory_ceiling = options.memory_limit;
+        build_out_of_core(reader);
+        return;
+    }
+    vector<string> words;
+    reader.read(words, static_cast<size_t>(-1));
+    build_in_memory(std::move(words), options);
+}
+
+void WordGraph::build_in_memory(vector<string> words, const WordGraphOptions &options) {
+    // Remove duplicates while preserving original order mapping
+    vector<pair<string, int> > word_with_order;
+    word_with_order.reserve(words.size());
+    for (int i = 0; i < static_cast<int>(words.size()); ++i) {
+        word_with_order.push_back(make_pair(std::move(words[i]), i));
+    }
+    words.clear();
+    words.shrink_to_fit();
+
+    // Sort by word to remove duplicates
+    sort(word_with_order.begin(), word_with_order.end());
+
+    // Remove duplicates
+    vector<pair<string, int> >::iterator new_end = word_with_order.begin();
+    for (vector<pair<string, int> >::iterator it = word_with_order.begin(); it != word_with_order.end(); ++it) {
+        if (new_end == word_with_order.begin() || new_end[-1].first != it->first) {
+            if (new_end != it) {
+                *new_end = std::move(*it);
+            }
+            ++new_end;
+        }
+    }
+    word_with_order.erase(new_end, word_with_order.end());
+
+    // Fill the letter masks, Bloom filter and word storage in one pass.
+    // Front-coded, each string is freed as soon as it is encoded, so the two
+    // copies of the dictionary never coexist.
+    storage = options.compact ? Storage::FrontCoded : Storage::Strings;
+    num_words = word_with_order.size();
+    filter = BlockedBloomFilter(num_words);
+    if (storage == Storage::Strings) {
+        dictionary.reserve(num_words);
+    }
+    original_order.reserve(num_words);
+
+    for (size_t i = 0; i < word_with_order.size(); ++i) {
+        string &word = word_with_order[i].first;
+        longest_word = max(longest_word, word.length());
+        add_to_letter_masks(word);
+        filter.add(word);
+        original_order.push_back(word_with_order[i].second);
+        if (storage == Storage::FrontCoded) {
+            front_coded.append(word);
+            string().swap(word);
+        } else {
+            dictionary.push_back(std::move(word));
+        }
+    }
+    vector<pair<string, int> >().swap(word_with_order);
+    // One extra slot so an insert into the longest word finds no masks
+    letter_mask_offset.resize(longest_word + 2, NO_LETTER_MASKS);
+    order = original_order.data();
+
+    if (storage == Storage::FrontCoded) {
+        front_coded.finish();
+#ifdef __GLIBC__
+        malloc_trim(0);  // Hand the freed strings back to the OS
+#endif
+    }
+    if (options.anagram_index) {
+        build_anagram_index();
+    }
+}
+
+// Bytes of memory the process has resident, or 0 if that is unknown. Reads
+// into a local buffer, so searches can call it without allocating.
+static size_t resident_memory() {
+    char buffer[128];
+    int fd = open("/proc/self/statm", O_RDONLY);
+    if (fd == -1) {
+        return 0;
+    }
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length <= 0) {
+        return 0;
+    }
+    buffer[length] = '\0';
+    unsigned long total_pages;
+    unsigned long resident_pages;
+    if (sscanf(buffer, "%lu %lu", &total_pages, &resident_pages) != 2) {
+        return 0;
+    }
+    return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Sort the dictionary in runs that fit half of what the memory limit leaves
+// beside the program itself, then merge the runs into mapped image files,
+// dropping duplicates. Only the letter masks, Bloom filter and page directory
+// stay on the heap.
+void WordGraph::build_out_of_core(DictionaryReader &reader) {
+    storage = Storage::Mapped;
+    const size_t available = memory_ceiling - min(memory_ceiling, resident_memory());
+    const size_t run_budget = max<size_t>(available / 2, 1 << 18);
+    const size_t lines_per_read = 4096;
+
+    vector<int> run_fds;
+    vector<pair<string, int> > run;
+    size_t run_bytes = 0;
+    // Every entry is charged at least its own size, so the run never outgrows
+    // the capacity reserved for it and is never copied to grow
+    auto write_run = [&]() {
+        sort(run.begin(), run.end());
+        run_fds.push_back(SortedRun::write(run));
+        vector<pair<string, int> >().swap(run);
+        run_bytes = 0;
+    };
+    vector<string> words;
+    int position = 0;
+    for (bool more = true; more; ) {
+        words.clear();
+        more = reader.read(words, lines_per_read);
+        for (size_t i = 0; i < words.size(); ++i) {
+            if (run.empty()) {
+                run.reserve(run_budget / sizeof(pair<string, int>) + 1);
+            }
+            run_bytes += sizeof(pair<string, int>) + words[i].capacity();
+            run.push_back(make_pair(std::move(words[i]), position++));
+            if (run_bytes >= run_budget) {
+                write_run();
+            }
+        }
+    }
+    if (!run.empty()) {
+        write_run();
+    }
+
+    // Merge, keeping each word's first input position: equal words come out
+    // of the heap ordered by position
+    vector<unique_ptr<SortedRun> > runs;
+    typedef pair<pair<string, int>, size_t> HeapEntry;  // Entry and its run
+    priority_queue<HeapEntry, vector<HeapEntry>, greater<HeapEntry> > heap;
+    for (size_t i = 0; i < run_fds.size(); ++i) {
+        runs.emplace_back(new SortedRun(run_fds[i]));
+        HeapEntry entry;
+        entry.second = i;
+        if (runs[i]->next(entry.first)) {
+            heap.push(entry);
+        }
+    }
+
+    // A smaller filter only passes more non-words on to the lookup
+    filter = BlockedBloomFilter(static_cast<size_t>(position), available / 4);
+    TempFileWriter chars, offsets, positions;
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t last_page = static_cast<size_t>(-1);
+    string previous;
+    while (!heap.empty()) {
+        HeapEntry entry = heap.top();
+        heap.pop();
+        const string &word = entry.first.first;
+        if (num_words == 0 || word != previous) {
+            uint64_t offset = chars.size();
+            if (offset / page_size != last_page) {
+                last_page = offset / page_size;
+                page_first_id.push_back(static_cast<int>(num_words));
+                page_first_word.push_back(word);
+            }
+            offsets.append(&offset, sizeof(offset));
+            chars.append(word.data(), word.length());
+            positions.append(&entry.first.second, sizeof(int));
+            longest_word = max(longest_word, word.length());
+            add_to_letter_masks(word);
+            filter.add(word);
+            previous = word;
+            ++num_words;
+        }
+        if (runs[entry.second]->next(entry.first)) {
+            heap.push(entry);
+        }
+    }
+    runs.clear();
+    uint64_t end_offset = chars.size();
+    offsets.append(&end_offset, sizeof(end_offset));
+    // One extra slot so an insert into the longest word finds no masks
+    letter_mask_offset.resize(longest_word + 2, NO_LETTER_MASKS);
+
+    size_t chars_size = chars.size();
+    size_t offsets_size = offsets.size();
+    size_t positions_size = positions.size();
+    mapped_chars.map(chars.finish(), chars_size);
+    mapped_offsets.map(offsets.finish(), offsets_size);
+    mapped_order.map(positions.finish(), positions_size);
+    image_chars = static_cast<const char *>(mapped_chars.data());
+    image_offsets = static_cast<const uint64_t *>(mapped_offsets.data());
+    order = static_cast<const int *>(mapped_order.data());
+
+    // A word's offset pair and its characters may each straddle a page. A
+    // lookup searches the offsets of the words starting on one directory
+    // page, and their characters, which may run past that page.
+    size_t most_ids_per_page = 0;
+    for (size_t i = 0; i < page_first_id.size(); ++i) {
+        int next = i + 1 < page_first_id.size() ? page_first_id[i + 1] : static_cast<int>(num_words);
+        most_ids_per_page = max(most_ids_per_page, static_cast<size_t>(next - page_first_id[i]));
+    }
+    word_pages = 4 + longest_word / page_size;
+    lookup_pages = 2 + (most_ids_per_page + 1) * sizeof(uint64_t) / page_size + 2 + longest_word / page_size;
+}
+
+void WordGraph::release_pages() const {
+    mapped_chars.release_pages();
+    mapped_offsets.release_pages();
+    mapped_order.release_pages();
+}
+
+string WordGraph::word(int word_id) const {
+    string result;
+    copy_word(word_id, result);
+    return result;
+}
+
+int WordGraph::find_word_id(const string& word) const {
+    if (storage == Storage::FrontCoded) {
+        return front_coded.find(word);
+    }
+    if (storage == Storage::Mapped) {
+        return find_mapped_word_id(word);
+    }
+    
+    // Binary search on sorted dictionary
+    int left = 0;
+    int right = static_cast<int>(dictionary.size()) - 1;
+
+    while (left <= right) {
+        int mid = left + (right - left) / 2;
+        if (dictionary[mid] == word) {
+            return mid;
+        } else if (dictionary[mid] < word) {
+            left = mid + 1;
+        } else {
+            right = mid - 1;
+        }
+    }
+    return -1;
+}
+
+// Binary search the in-memory page directory, then the ids starting on that
+// page of the image
+int WordGraph::find_mapped_word_id(const string& word) const {
+    vector<string>::const_iterator page = upper_bound(page_first_word.begin(), page_first_word.end(), word);
+    if (page == page_first_word.begin()) {
+        return -1;
+    }
+    size_t page_index = static_cast<size_t>(page - page_first_word.begin()) - 1;
+    int left = page_first_id[page_index];
+    int right = (page_index + 1 < page_first_id.size() ? page_first_id[page_index + 1] : static_cast<int>(num_words)) - 1;
+
+    while (left <= right) {
+        int mid = left + (right - left) / 2;
+        const char *mid_word = image_chars + image_offsets[mid];
+        size_t mid_length = image_offsets[mid + 1] - image_offsets[mid];
+        int comparison = word.compare(0, word.length(), mid_word, mid_length);
+        if (comparison == 0) {
+            return mid;
+        } else if (comparison > 0) {
+            left = mid + 1;
+        } else {
+            right = mid - 1;
+        }
+    }
+    return -1;
+}
+
+// Record which letters each position of the word's length uses, so candidate
+// generation only tries letters that can lead to a dictionary word
+void WordGraph::add_to_letter_masks(const string &word) {
+    size_t length = word.length();
+    if (length + 2 > letter_mask_offset.size()) {
+        letter_mask_offset.resize(length + 2, NO_LETTER_MASKS);
+    }
+    if (letter_mask_offset[length] == NO_LETTER_MASKS) {
+        letter_mask_offset[length] = letter_masks.size();
+        letter_masks.resize(letter_masks.size() + length);
+    }
+    LetterMask *masks = &letter_masks[letter_mask_offset[length]];
+    for (size_t pos = 0; pos < length; ++pos) {
+        masks[pos].add(static_cast<unsigned char>(word[pos]));
+    }
+}
+
+// Group words by their sorted letters. A swap never changes a word's letters,
+// so only words sharing a class can be swap neighbors.
+void WordGraph::build_anagram_index() {
+    vector<string> signatures(num_words);
+    vector<int> by_signature(num_words);
+    for (size_t i = 0; i < num_words; ++i) {
+        copy_word(static_cast<int>(i), signatures[i]);
+        sort(signatures[i].begin(), signatures[i].end());
+        by_signature[i] = static_cast<int>(i);
+    }
+    // Ids are sorted to begin with, so members come out ascending
+    stable_sort(by_signature.begin(), by_signature.end(), [&](int a, int b) {
+        return signatures[a] < signatures[b];
+    });
+
+    anagram_class_of.assign(num_words, -1);
+    anagram_class_offset.push_back(0);
+    for (size_t start = 0; start < by_signature.size(); ) {
+        size_t end = start + 1;
+        while (end < by_signature.size() && signatures[by_signature[end]] == signatures[by_signature[start]]) {
+            ++end;
+        }
+        if (end - start > 1) {
+            int anagram_class = static_cast<int>(anagram_class_offset.size()) - 1;
+            for (size_t i = start; i < end; ++i) {
+                anagram_class_of[by_signature[i]] = anagram_class;
+                anagram_members.push_back(by_signature[i]);
+            }
+            anagram_class_offset.push_back(anagram_members.size());
+        }
+        start = end;
+    }
+    // Keep the index valid even with no classes
+    anagram_members.push_back(-1);
+}
+
+// Calls visit on each letter of the mask in ascending byte order, stopping
+// and returning true as soon as visit returns true
+template <typename Visitor>
+inline bool for_each_letter(const LetterMask &mask, Visitor visit) {
+    for (unsigned word = 0; word < 4; ++word) {
+        uint64_t bits = mask.bits[word];
+        while (bits != 0) {
+            unsigned letter = word * 64 + static_cast<unsigned>(__builtin_ctzll(bits));
+            bits &= bits - 1;
+            if (visit(static_cast<char>(letter))) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+SearchContext::SearchContext(const WordGraph &graph)
+    : graph(graph), file_backed(graph.memory_limit() != 0) {
+    // Size all search scratch space up front. Every neighbor list holds
+    // distinct words, at most one per change, insert, delete or swap.
+    parent_info.assign(graph.size(), -2, file_backed);
+    frontier.assign(graph.size(), 0, file_backed);
+    discovered.assign(graph.size(), 0, file_backed);
+    size_t length = graph.max_word_length();
+    neighbors.reserve(min(graph.size(), 256 * (2 * length + 1) + 2 * length));
+    current_word.reserve(graph.max_word_length());
+    swap_partners.reserve(graph.max_word_length());
+    working_buffer.reserve(graph.max_word_length() + 1);
+    if (file_backed) {
+        graph.register_search(1);
+        check_memory();
+    }
+}
+
+SearchContext::~SearchContext() {
+    if (file_backed) {
+        graph.register_search(-1);
+    }
+}
+
+// A fault on a mapped file also maps the neighboring pages already in the
+// page cache, up to the kernel's default fault-around of 64 KB
+static const size_t FAULT_AROUND_PAGES = 16;
+
+// Out of core, count the mapped pages a search step is about to touch. The
+// counts are upper bounds, so once the allowance the last measurement left
+// runs out, memory is measured again before anything more is touched.
+inline void SearchContext::touch_pages(size_t pages) {
+    if (!file_backed) {
+        return;
+    }
+    if (pages > pages_until_check) {
+        check_memory();
+    }
+    pages_until_check -= min(pages, pages_until_check);
+}
+
+// Measure what the process holds resident, heap included, and drop every
+// mapped page if the room left under the limit is nearly gone. Where the
+// program's own footprint leaves no room under the limit, the footprint after
+// a release plus a little room stands in for it. The next allowance is this
+// context's share of the room, in touches that may each fault around.
+void SearchContext::check_memory() {
+    static const size_t MIN_CHECK_PAGES = 16;
+    static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t touch_bytes = FAULT_AROUND_PAGES * page_size * graph.search_count();
+    const size_t min_room = MIN_CHECK_PAGES * touch_bytes;
+    size_t ceiling = max(graph.memory_limit(), memory_floor + 2 * min_room);
+    size_t resident = resident_memory();
+    if (resident + min_room > ceiling) {
+        release_pages();
+        resident = memory_floor = resident_memory();
+        ceiling = max(graph.memory_limit(), memory_floor + 2 * min_room);
+    }
+    pages_until_check = max((ceiling - min(ceiling, resident)) / touch_bytes, MIN_CHECK_PAGES);
+}
+
+// Drop every resident mapped page, the graph's included; they fault back in
+// from their files as they are needed
+void SearchContext::release_pages() {
+    graph.release_pages();
+    parent_info.release_pages();
+    mod_info.release_pages();
+    path_cost.release_pages();
+    discovered.release_pages();
+    frontier.release_pages();
+}
+
+// Out of core, charge what the Dijkstra buckets have grown by to the budget
+void SearchContext::charge_buckets() {
+    static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t bytes = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        bytes += buckets[i].capacity() * sizeof(int);
+    }
+    if (bytes > bucket_bytes) {
+        size_t grown = bytes - bucket_bytes;
+        bucket_bytes = bytes;
+        touch_pages((grown + page_size - 1) / page_size);
+    }
+}
+
+// Forget the previous query, touching only the words it discovered
+void SearchContext::reset() {
+    for (size_t i = 0; i < discovered_count; ++i) {
+        touch_pages(2);
+        parent_info[discovered[i]] = -2;
+    }
+    if (!path_cost.empty()) {
+        for (size_t i = 0; i < discovered_count; ++i) {
+            touch_pages(2);
+            path_cost[discovered[i]] = -1;
+        }
+    }
+    discovered_count = 0;
+}
+
+inline void SearchContext::discover(int word_id, int parent_id) {
+    touch_pages(2);
+    parent_info[word_id] = parent_id;
+    discovered[discovered_count++] = word_id;
+}
+
+// Look up a generated candidate, letting the Bloom filter reject most
+// non-words before the real search
+inline int SearchContext::lookup_candidate(const string &candidate) {
+    ++search_stats.candidate_lookups;
+    if (!graph.might_contain(candidate)) {
+        ++search_stats.filter_rejections;
+        return -1;
+    }
+    touch_pages(graph.pages_per_lookup());
+    int word_id = graph.find_word_id(candidate);
+    if (word_id == -1) {
+        ++search_stats.false_positives;
+    }
+    return word_id;
+}
+
+// Enumerate every dictionary word one modification away from the current word,
+// in the fixed order change, insert, delete, swap. The visitor receives each
+// hit (possibly more than once) together with the modification that produced it,
+// and returns true to stop the enumeration; the result says whether it stopped.
+template <unsigned Modes, typename Visitor>
+bool SearchContext::for_each_neighbor(int current_word_id, Visitor visit) {
+    touch_pages(graph.pages_per_word());
+    graph.copy_word(current_word_id, current_word);
+    const string& word = current_word;
+    assert(!word.empty());
+
+    // Change mode: change one letter, trying only letters some word of this
+    // length has at that position
+    if constexpr ((Modes & MODE_CHANGE) != 0) {
+        const LetterMask *masks = graph.letters_at(word.length());
+        for (size_t i = 0; i < word.length(); ++i) {
+            bool stopped = for_each_letter(masks[i], [&](char c) {
+                if (c == word[i]) {
+                    return false;
+                }
+                working_buffer = word;
+                working_buffer[i] = c;
+
+                int new_word_id = lookup_candidate(working_buffer);
+                if (new_word_id == -1) {
+                    return false;
+                }
+                ModificationInfo info;
+                info.modification_type = 1; // 'c'
+                info.modification_pos = static_cast<unsigned char>(i);
+                info.modification_char = c;
+                return visit(new_word_id, info);
+            });
+            if (stopped) {
+                return true;
+            }
+        }
+    }
+
+    // Length mode: insert and delete
+    if constexpr ((Modes & MODE_LENGTH) != 0) {
+        // Insert a letter at each position, skipping inserts entirely when no
+        // word is one letter longer
+        const LetterMask *masks = graph.letters_at(word.length() + 1);
+        for (size_t i = 0; masks != nullptr && i <= word.length(); ++i) {
+            bool stopped = for_each_letter(masks[i], [&](char c) {
+                working_buffer = word;
+                working_buffer.insert(i, 1, c);
+
+                int new_word_id = lookup_candidate(working_buffer);
+                if (new_word_id == -1) {
+                    return false;
+                }
+                ModificationInfo info;
+                info.modification_type = 2; // 'i'
+
+                // Find the first difference position between parent and new word
+                int first_diff = 0;
+                while (first_diff < static_cast<int>(word.length()) &&
+                       first_diff < static_cast<int>(working_buffer.length()) &&
+                       word[first_diff] == working_buffer[first_diff]) {
+                    first_diff++;
+                }
+
+                info.modification_pos = static_cast<unsigned char>(first_diff);
+                info.modification_char = c;
+                return visit(new_word_id, info);
+            });
+            if (stopped) {
+                return true;
+            }
+        }
+
+        // Delete a letter at each position
+        for (size_t i = 0; i < word.length(); ++i) {
+            working_buffer = word;
+            working_buffer.erase(i, 1);
+
+            int new_word_id = lookup_candidate(working_buffer);
+            if (new_word_id != -1) {
+                ModificationInfo info;
+                info.modification_type = 3; // 'd'
+
+                // Find the first difference position between parent and new word
+                int first_diff = 0;
+                while (first_diff < static_cast<int>(working_buffer.length()) &&
+                       first_diff < static_cast<int>(word.length()) &&
+                       working_buffer[first_diff] == word[first_diff]) {
+                    first_diff++;
+                }
+
+                info.modification_pos = static_cast<unsigned char>(first_diff);
+                if (visit(new_word_id, info)) {
+                    return true;
+                }
+            }
+        }
+    }
+
+    // Swap mode: swap adjacent letters. With the anagram index, compare the
+    // word against the other members of its class instead of looking up every
+    // swap; a word alone in its class has no swap neighbors at all.
+    if constexpr ((Modes & MODE_SWAP) != 0) {
+        if (graph.has_anagram_index()) {
+            int anagram_class = graph.anagram_class(current_word_id);
+            if (anagram_class == -1) {
+                return false;
+            }
+            swap_partners.clear();
+            for (const int *member = graph.anagram_members_begin(anagram_class);
+                 member != graph.anagram_members_end(anagram_class); ++member) {
+                if (*member == current_word_id) {
+                    continue;
+                }
+                touch_pages(graph.pages_per_word());
+                graph.copy_word(*member, working_buffer);
+                size_t i = 0;
+                while (working_buffer[i] == word[i]) {
+                    ++i;
+                }
+                if (i + 1 < word.length() && working_buffer[i] == word[i + 1] && working_buffer[i + 1] == word[i] &&
+                    working_buffer.compare(i + 2, string::npos, word, i + 2, string::npos) == 0) {
+                    swap_partners.push_back(make_pair(i, *member));
+                }
+            }
+            // Visit in swap position order, as the lookup loop below does
+            sort(swap_partners.begin(), swap_partners.end());
+            for (size_t p = 0; p < swap_partners.size(); ++p) {
+                ModificationInfo info;
+                info.modification_type = 4; // 's'
+                info.modification_pos = static_cast<unsigned char>(swap_partners[p].first);
+                if (visit(swap_partners[p].second, info)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        for (size_t i = 0; i < word.length() - 1; ++i) {
+            working_buffer = word;
+            swap(working_buffer[i], working_buffer[i + 1]);
+
+            int new_word_id = lookup_candidate(working_buffer);
+            if (new_word_id != -1) {
+                ModificationInfo info;
+                info.modification_type = 4; // 's'
+                info.modification_pos = static_cast<unsigned char>(i);
+                if (visit(new_word_id, info)) {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+// Sort word ids by their original dictionary order
+void SearchContext::sort_by_original_order(vector<int> &word_ids) const {
+    sort(word_ids.begin(), word_ids.end());
+    // Use stable_sort with custom comparison
+    for (int i = 0; i < static_cast<int>(word_ids.size()); ++i) {
+        for (int j = i + 1; j < static_cast<int>(word_ids.size()); ++j) {
+            if (graph.original_position(word_ids[i]) > graph.original_position(word_ids[j])) {
+                swap(word_ids[i], word_ids[j]);
+            }
+        }
+    }
+}
+
+// Generate all undiscovered words from current word based on allowed modifications.
+// Discovery is lazy: as soon as the end word is discovered the enumeration stops
+// and true is returned, leaving the remaining candidates untouched. The end
+// word's parent and modification are fixed by its first discovery either way,
+// and a search that fails enumerates everything, so paths and discovered counts
+// match a full expansion.
+template <unsigned Modes>
+bool SearchContext::generate_neighbors(int current_word_id, int end_word_id) {
+    assert(neighbors.empty());
+    assert(current_word_id >= 0 && current_word_id < static_cast<int>(graph.size()));
+    assert(parent_info[current_word_id] != -2); // Must be discovered
+
+    bool found_end = for_each_neighbor<Modes>(current_word_id, [&](int new_word_id, const ModificationInfo &info) {
+        touch_pages(2);
+        if (parent_info[new_word_id] == -2) {
+            neighbors.push_back(new_word_id);
+            discover(new_word_id, current_word_id);
+
+            // Only store modification details if needed
+            if constexpr ((Modes & MODE_WORD_OUTPUT) == 0) {
+                mod_info[new_word_id] = info;
+            }
+            return new_word_id == end_word_id;
+        }
+        return false;
+    });
+    if (found_end) {
+        return true;
+    }
+
+    // Sort neighbors by their original dictionary order
+    touch_pages(neighbors.size());
+    sort_by_original_order(neighbors);
+    return false;
+}
+
+// Reconstruct path from end word back to begin word
+void SearchContext::reconstruct_path(int begin_word_id, int end_word_id, vector <int> &path) {
+    int current = end_word_id;
+
+    while (current != begin_word_id) {
+        path.push_back(current);
+        touch_pages(1);
+        current = parent_info[current];
+    }
+    path.push_back(begin_word_id);
+
+    reverse(path.begin(), path.end());
+}
+
+// BFS implementation
+template <unsigned Modes>
+bool SearchContext::search_bfs(int begin_word_id, int end_word_id) {
+    LargeArray<int> &search_container = frontier;
+    size_t head = 0;
+    size_t tail = 0;
+
+    // Initialize with begin word
+    touch_pages(1);
+    search_container[tail++] = begin_word_id;
+    discover(begin_word_id, -1); // -1 means begin word (discovered but no parent)
+
+    NoAllocationScope no_allocations;
+    while (head < tail) {
+        // Fetch and remove from front (queue behavior)
+        touch_pages(1);
+        int current_word_id = search_container[head++];
+
+        // Check if we reached the end
+        if (current_word_id == end_word_id) {
+            return true;
+        }
+
+        // Investigate: generate all valid neighbors
+        neighbors.clear();
+        if (generate_neighbors<Modes>(current_word_id, end_word_id)) {
+            return true; // Found the end word
+        }
+
+        // Add neighbors to back of container (queue behavior)
+        for (size_t i = 0; i < neighbors.size(); ++i) {
+            touch_pages(1);
+            search_container[tail++] = neighbors[i];
+        }
+    }
+
+    return false; // No path found
+}
+
+// DFS implementation
+template <unsigned Modes>
+bool SearchContext::search_dfs(int begin_word_id, int end_word_id) {
+    LargeArray<int> &search_container = frontier;
+    size_t top = 0;
+
+    // Initialize with begin word
+    touch_pages(1);
+    search_container[top++] = begin_word_id;
+    discover(begin_word_id, -1); // -1 means begin word (discovered but no parent)
+
+    NoAllocationScope no_allocations;
+    while (top > 0) {
+        // Fetch and remove from back (stack behavior - LIFO)
+        touch_pages(1);
+        int current_word_id = search_container[--top];
+
+        // Check if we reached the end
+        if (current_word_id == end_word_id) {
+            return true;
+        }
+
+        // Investigate: generate all valid neighbors
+        neighbors.clear();
+        if (generate_neighbors<Modes>(current_word_id, end_word_id)) {
+            return true; // Found the end word
+        }
+
+        // Add neighbors to back of container in normal order (stack behavior)
+        for (size_t i = 0; i < neighbors.size(); ++i) {
+            touch_pages(1);
+            search_container[top++] = neighbors[i];
+        }
+    }
+
+    return false; // No path found
+}
+
+// Dijkstra implementation. Modification costs are small positive integers, so
+// the frontier is a circular array of FIFO buckets (Dial's algorithm): a word
+// with path cost d lives in bucket d % (max_cost + 1), and every push and pop
+// is O(1). Stale entries left behind by a cheaper relaxation are skipped.
+template <unsigned Modes>
+bool SearchContext::search_dijkstra(int begin_word_id, int end_word_id, const int *costs, int &total_cost) {
+    int max_cost = *max_element(costs + 1, costs + 5);
+    buckets.resize(max_cost + 1);
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        buckets[i].clear();
+    }
+    vector<int> &improved = neighbors;
+    improved.clear();
+
+    // Initialize with begin word
+    buckets[0].push_back(begin_word_id);
+    touch_pages(1);
+    path_cost[begin_word_id] = 0;
+    discover(begin_word_id, -1); // -1 means begin word (discovered but no parent)
+    size_t pending = 1;
+
+    for (int cost = 0; pending > 0; ++cost) {
+        vector<int> &bucket = buckets[cost % (max_cost + 1)];
+
+        // Costs are positive, so expanding this bucket never appends to it
+        for (size_t b = 0; b < bucket.size(); ++b) {
+            int current_word_id = bucket[b];
+            --pending;
+
+            // Skip entries superseded by a cheaper path
+            touch_pages(1);
+            if (path_cost[current_word_id] != cost) {
+                continue;
+            }
+
+            // Check if we reached the end
+            if (current_word_id == end_word_id) {
+                total_cost = cost;
+                return true;
+            }
+
+            // Relax every neighbor reachable more cheaply through this word
+            for_each_neighbor<Modes>(current_word_id, [&](int new_word_id, const ModificationInfo &info) {
+                int new_cost = cost + costs[info.modification_type];
+                touch_pages(3);
+                if (path_cost[new_word_id] == -1 || new_cost < path_cost[new_word_id]) {
+                    if (path_cost[new_word_id] == -1) {
+                        improved.push_back(new_word_id);
+                        discover(new_word_id, current_word_id);
+                    } else {
+                        if (find(improved.begin(), improved.end(), new_word_id) == improved.end()) {
+                            improved.push_back(new_word_id);
+                        }
+                        parent_info[new_word_id] = current_word_id;
+                    }
+                    path_cost[new_word_id] = new_cost;
+
+                    // Only store modification details if needed
+                    if constexpr ((Modes & MODE_WORD_OUTPUT) == 0) {
+                        mod_info[new_word_id] = info;
+                    }
+                }
+                return false;
+            });
+
+            // Queue in original dictionary order so equal-cost ties break like the queue search
+            touch_pages(improved.size());
+            sort_by_original_order(improved);
+            for (size_t i = 0; i < improved.size(); ++i) {
+                touch_pages(1);
+                buckets[path_cost[improved[i]] % (max_cost + 1)].push_back(improved[i]);
+                ++pending;
+            }
+            improved.clear();
+            if (file_backed) {
+                charge_buckets();
+            }
+        }
+        bucket.clear();
+    }
+
+    return false; // No path found
+}
+
+// The search engines specialized for one mode set
+struct SearchContext::SearchEngines {
+    bool (SearchContext::*bfs)(int, int);
+    bool (SearchContext::*dfs)(int, int);
+    bool (SearchContext::*dijkstra)(int, int, const int *, int &);
+};
+
+template <size_t... ModeSets>
+const SearchContext::SearchEngines& SearchContext::select_search_engines(unsigned modes,
+                                                                         index_sequence<ModeSets...>) {
+    static const SearchEngines engines[] = {
+        { &SearchContext::search_bfs<ModeSets>, &SearchContext::search_dfs<ModeSets>,
+          &SearchContext::search_dijkstra<ModeSets> }...
+    };
+    return engines[modes];
+}
+
+// Clear the previous query, size scratch space for this one and pick its engines
+const SearchContext::SearchEngines& SearchContext::prepare(const Query &query) {
+    assert(query.begin_word_id >= 0 && query.begin_word_id < static_cast<int>(graph.size()));
+    assert(query.modes < NUM_MODE_SETS);
+
+    reset();
+    bool word_output = (query.modes & MODE_WORD_OUTPUT) != 0;
+    if (!word_output && mod_info.empty()) {
+        mod_info.assign(graph.size(), ModificationInfo(), file_backed);
+    }
+    if (query.routing == Routing::Dijkstra && path_cost.empty()) {
+        path_cost.assign(graph.size(), -1, file_backed); // -1 means undiscovered
+    }
+    if (file_backed) {
+        check_memory();
+    }
+
+    // Dispatch once to the instantiation for this mode set
+    return select_search_engines(query.modes, make_index_sequence<NUM_MODE_SETS>());
+}
+
+QueryResult SearchContext::search(const Query &query) {
+    assert(query.end_word_id >= 0 && query.end_word_id < static_cast<int>(graph.size()));
+
+    const SearchEngines &engines = prepare(query);
+    bool word_output = (query.modes & MODE_WORD_OUTPUT) != 0;
+    QueryResult result;
+    if (query.routing == Routing::Queue) {
+        result.found = (this->*engines.bfs)(query.begin_word_id, query.end_word_id);
+    } else if (query.routing == Routing::Stack) {
+        result.found = (this->*engines.dfs)(query.begin_word_id, query.end_word_id);
+    } else {
+        result.found = (this->*engines.dijkstra)(query.begin_word_id, query.end_word_id,
+                                                 query.costs, result.total_cost);
+    }
+
+    if (result.found) {
+        reconstruct_path(query.begin_word_id, query.end_word_id, result.path);
+        if (!word_output) {
+            result.modifications.resize(result.path.size());
+            for (size_t i = 1; i < result.path.size(); ++i) {
+                touch_pages(1);
+                result.modifications[i] = mod_info[result.path[i]];
+            }
+        }
+    } else {
+        result.discovered_count = static_cast<int>(discovered_count);
+    }
+    return result;
+}
+
+void SearchContext::build_parent_tree(const Query &query, ParentTree &tree) {
+    assert(query.routing != Routing::Dijkstra);
+
+    // No end word (-1) is ever discovered, so the search runs to exhaustion
+    const SearchEngines &engines = prepare(query);
+    if (query.routing == Routing::Queue) {
+        (this->*engines.bfs)(query.begin_word_id, -1);
+    } else {
+        (this->*engines.dfs)(query.begin_word_id, -1);
+    }
+
+    tree.begin_word_id = query.begin_word_id;
+    tree.word_ids.resize(discovered_count);
+    for (size_t i = 0; i < discovered_count; ++i) {
+        touch_pages(1);
+        tree.word_ids[i] = discovered[i];
+    }
+    sort(tree.word_ids.begin(), tree.word_ids.end());
+    tree.parents.resize(tree.word_ids.size());
+    tree.modifications.clear();
+    for (size_t i = 0; i < tree.word_ids.size(); ++i) {
+        touch_pages(1);
+        tree.parents[i] = parent_info[tree.word_ids[i]];
+    }
+    if ((query.modes & MODE_WORD_OUTPUT) == 0) {
+        tree.modifications.resize(tree.word_ids.size());
+        for (size_t i = 0; i < tree.word_ids.size(); ++i) {
+            touch_pages(1);
+            tree.modifications[i] = mod_info[tree.word_ids[i]];
+        }
+    }
+}
+
+int ParentTree::index_of(int word_id) const {
+    vector<int>::const_iterator it = lower_bound(word_ids.begin(), word_ids.end(), word_id);
+    if (it == word_ids.end() || *it != word_id) {
+        return -1;
+    }
+    return static_cast<int>(it - word_ids.begin());
+}
+
+QueryResult ParentTree::answer(int end_word_id) const {
+    QueryResult result;
+    int index = index_of(end_word_id);
+    if (index == -1) {
+        result.discovered_count = static_cast<int>(word_ids.size());
+        return result;
+    }
+
+    // Walk back to the begin word, then reverse as reconstruct_path does
+    result.found = true;
+    vector<int> indexes;
+    for (int current = index; word_ids[current] != begin_word_id; current = index_of(parents[current])) {
+        indexes.push_back(current);
+    }
+    indexes.push_back(index_of(begin_word_id));
+    reverse(indexes.begin(), indexes.end());
+
+    result.path.resize(indexes.size());
+    for (size_t i = 0; i < indexes.size(); ++i) {
+        result.path[i] = word_ids[indexes[i]];
+    }
+    if (!modifications.empty()) {
+        result.modifications.resize(indexes.size());
+        for (size_t i = 1; i < indexes.size(); ++i) {
+            result.modifications[i] = modifications[indexes[i]];
+        }
+    }
+    return result;
+}
+
+size_t ParentTree::memory_usage() const {
+    return sizeof(ParentTree) + word_ids.capacity() * sizeof(int) + parents.capacity() * sizeof(int) +
+           modifications.capacity() * sizeof(ModificationInfo);
+}
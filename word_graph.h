@@ -0,0 +1,457 @@
+// Project Identifier: 50EB44D3F029ED934858FFFCEAC3547C68251FC9
+
+#ifndef WORD_GRAPH_H
+#define WORD_GRAPH_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Modification that turns a word's parent into the word
+struct ModificationInfo {
+    unsigned char modification_type;  // 0=none, 1=c, 2=i, 3=d, 4=s
+    unsigned char modification_pos;
+    char modification_char;
+
+    ModificationInfo() : modification_type(0), modification_pos(0), modification_char(' ') {}
+};
+
+// Set of byte values, one bit per possible letter
+struct LetterMask {
+    uint64_t bits[4];
+
+    LetterMask() : bits{0, 0, 0, 0} {}
+    void add(unsigned char letter) { bits[letter >> 6] |= uint64_t(1) << (letter & 63); }
+};
+
+// Mode set bits used to specialize the neighbor generator and search loops
+// at compile time; a search dispatches once to the matching instantiation
+const unsigned MODE_CHANGE = 1;
+const unsigned MODE_LENGTH = 2;
+const unsigned MODE_SWAP = 4;
+const unsigned MODE_WORD_OUTPUT = 8;
+const unsigned NUM_MODE_SETS = 16;
+
+enum class Routing { Stack, Queue, Dijkstra };
+
+// One morph request. Both words must be in the dictionary (see
+// WordGraph::find_word_id); modes is a combination of the MODE_* bits.
+struct Query {
+    Routing routing = Routing::Queue;
+    unsigned modes = MODE_WORD_OUTPUT;
+    int begin_word_id = -1;
+    int end_word_id = -1;
+    int costs[5] = {0, 1, 1, 1, 1};  // Indexed by modification_type, dijkstra only
+};
+
+struct QueryResult {
+    bool found = false;
+    std::vector<int> path;                        // Word ids from begin to end word
+    std::vector<ModificationInfo> modifications;  // Step into path[i]; empty for word output
+    int total_cost = 0;                           // Dijkstra only
+    int discovered_count = 0;                     // Words discovered by a failed search
+};
+
+// Sorted word list stored front-coded: words are grouped in blocks of
+// BLOCK_SIZE, the first word of a block is stored whole, and every later one
+// as the length of the prefix it shares with its predecessor plus the rest.
+// Block heads double as a sampled directory for binary search.
+class FrontCodedDictionary {
+public:
+    static const size_t BLOCK_SIZE = 16;
+
+    FrontCodedDictionary() {}
+
+    // Add the next word; words must come sorted and free of duplicates
+    void append(const std::string &word);
+    // Drop spare capacity once the last word is in
+    void finish();
+
+    size_t size() const { return num_words; }
+    size_t memory_usage() const;
+
+    // Id of the word, or -1 if it is not in the dictionary
+    int find(const std::string &word) const;
+
+    // Decode the word with the given id into out
+    void decode(int word_id, std::string &out) const;
+
+private:
+    std::vector<unsigned char> data;
+    std::vector<size_t> block_offsets;  // Start of each block in data
+    size_t num_words = 0;
+    std::string previous;               // The last word appended
+
+    void append_varint(size_t value);
+    static size_t read_varint(const unsigned char *&ptr);
+};
+
+// Bloom filter whose probes for one key all land in a single 64-byte block,
+// so rejecting a non-word costs one cache miss instead of a binary search
+class BlockedBloomFilter {
+public:
+    BlockedBloomFilter() {}
+    // Empty filter sized for the given number of words, in at most max_bytes
+    explicit BlockedBloomFilter(size_t expected_words, size_t max_bytes = SIZE_MAX);
+
+    void add(const std::string &word);
+
+    // False means the word is certainly absent
+    bool might_contain(const std::string &word) const {
+        uint64_t hash = hash_word(word);
+        const Block &block = blocks[((hash >> 32) * blocks.size()) >> 32];
+        uint64_t bit_hash = mix(hash);
+        for (unsigned i = 0; i < NUM_PROBES; ++i, bit_hash >>= 9) {
+            unsigned bit = static_cast<unsigned>(bit_hash & 511);
+            if ((block.bits[bit >> 6] & (uint64_t(1) << (bit & 63))) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t memory_usage() const { return blocks.capacity() * sizeof(Block); }
+
+private:
+    static const unsigned BITS_PER_WORD = 16;
+    static const unsigned NUM_PROBES = 6;
+
+    struct alignas(64) Block {
+        uint64_t bits[8];
+    };
+    std::vector<Block> blocks;
+
+    // FNV-1a, then a murmur finalizer to derive the in-block probes
+    static uint64_t hash_word(const std::string &word) {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < word.length(); ++i) {
+            hash = (hash ^ static_cast<unsigned char>(word[i])) * 1099511628211ull;
+        }
+        return hash;
+    }
+    static uint64_t mix(uint64_t hash) {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+};
+
+// Candidate lookup counters, kept per SearchContext
+struct SearchStats {
+    uint64_t candidate_lookups = 0;    // Generated candidates looked up
+    uint64_t filter_rejections = 0;    // Rejected by the Bloom filter alone
+    uint64_t false_positives = 0;      // Passed the filter but are not words
+
+    SearchStats& operator+=(const SearchStats &other) {
+        candidate_lookups += other.candidate_lookups;
+        filter_rejections += other.filter_rejections;
+        false_positives += other.false_positives;
+        return *this;
+    }
+};
+
+struct WordGraphOptions {
+    bool compact = false;        // Keep the dictionary front-coded instead of as strings
+    bool anagram_index = false;  // Group anagrams so swap neighbors skip lookups
+    size_t memory_limit = 0;     // Bytes; nonzero keeps the dictionary and search state out of core
+};
+
+// Temporary file mapped shared into memory. The file is unlinked as soon as
+// it is created, so it disappears along with the mapping.
+class MappedFile {
+public:
+    MappedFile() {}
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile& operator=(const MappedFile &) = delete;
+
+    // Unlinked temporary file in $TMPDIR (default /tmp), exiting on failure
+    static int create_temp_file();
+
+    // Map the first bytes of fd read/write and close fd
+    void map(int fd, size_t bytes);
+    // Map a new zero-filled temporary file
+    void create(size_t bytes);
+
+    void* data() const { return address; }
+    size_t size() const { return length; }
+
+    // Drop the resident pages of [offset, offset + bytes); their contents stay in the file
+    void release_pages(size_t offset, size_t bytes) const;
+    void release_pages() const { release_pages(0, length); }
+
+private:
+    void *address = nullptr;
+    size_t length = 0;
+};
+
+// Fixed-size array on the heap or, for out-of-core searches, in a mapped
+// temporary file whose pages can be dropped when memory runs short
+template <typename T>
+class LargeArray {
+public:
+    void assign(size_t count, const T &value, bool file_backed) {
+        if (!file_backed) {
+            heap.assign(count, value);
+            elements = heap.data();
+        } else {
+            file.create(count * sizeof(T));
+            elements = static_cast<T *>(file.data());
+            // Fill a chunk at a time, dropping each so the fill stays out of core
+            const size_t chunk = (size_t(1) << 20) / sizeof(T);
+            for (size_t start = 0; start < count; start += chunk) {
+                size_t end = std::min(count, start + chunk);
+                std::fill(elements + start, elements + end, value);
+                file.release_pages(start * sizeof(T), (end - start) * sizeof(T));
+            }
+        }
+        num_elements = count;
+    }
+
+    T* data() { return elements; }
+    T& operator[](size_t i) { return elements[i]; }
+    const T& operator[](size_t i) const { return elements[i]; }
+    size_t size() const { return num_elements; }
+    bool empty() const { return num_elements == 0; }
+
+    void release_pages() const { file.release_pages(); }
+
+private:
+    std::vector<T> heap;
+    MappedFile file;
+    T *elements = nullptr;
+    size_t num_elements = 0;
+};
+
+// Reads a simple ('S') or complex ('C') dictionary in the letter input format
+// a few lines at a time, so huge dictionaries can be consumed in pieces
+class DictionaryReader {
+public:
+    // Reads the header
+    explicit DictionaryReader(std::istream &in);
+
+    // Append the words of up to max_lines more dictionary lines in input
+    // order. Returns false once the dictionary is exhausted.
+    bool read(std::vector<std::string> &words, size_t max_lines);
+
+private:
+    std::istream &in;
+    char dict_type = ' ';
+    int lines_left = 0;
+};
+
+// Reads a whole dictionary, appending every word it describes in input order
+void read_dictionary(std::istream &in, std::vector<std::string> &words);
+
+// A loaded dictionary and its lookup indexes. Immutable once constructed, so
+// one instance can be shared by any number of threads searching concurrently.
+class WordGraph {
+public:
+    // Sorts and deduplicates words; ids are positions in sorted order
+    explicit WordGraph(std::vector<std::string> words, const WordGraphOptions &options = WordGraphOptions());
+    // Same, reading the dictionary itself. Out of core, it is sorted in runs
+    // that fit the memory limit and merged into mapped image files.
+    WordGraph(DictionaryReader &reader, const WordGraphOptions &options);
+
+    size_t size() const { return num_words; }
+    size_t max_word_length() const { return longest_word; }
+    std::string word(int word_id) const;
+
+    // Copy the word into out, reusing its capacity
+    void copy_word(int word_id, std::string &out) const {
+        if (storage == Storage::Strings) {
+            out = dictionary[word_id];
+        } else if (storage == Storage::FrontCoded) {
+            front_coded.decode(word_id, out);
+        } else {
+            out.assign(image_chars + image_offsets[word_id], image_offsets[word_id + 1] - image_offsets[word_id]);
+        }
+    }
+
+    // Position of the word's first occurrence in the input dictionary
+    int original_position(int word_id) const { return order[word_id]; }
+
+    // Out-of-core graphs report their memory limit; zero otherwise
+    size_t memory_limit() const { return memory_ceiling; }
+    // Drop the resident pages of the mapped dictionary image
+    void release_pages() const;
+
+    // Out of core: the most pages of the mapped image that copying out one
+    // word, or looking one up, can touch
+    size_t pages_per_word() const { return word_pages; }
+    size_t pages_per_lookup() const { return lookup_pages; }
+    // Out of core: search contexts split the room under the limit evenly
+    void register_search(int delta) const { live_searches += delta; }
+    size_t search_count() const { return static_cast<size_t>(std::max(live_searches.load(), 1)); }
+
+    // Id of the word, or -1 if it is not in the dictionary
+    int find_word_id(const std::string &word) const;
+
+    // Cheap pre-check for find_word_id; false means the word is absent
+    bool might_contain(const std::string &word) const { return filter.might_contain(word); }
+    size_t filter_memory_usage() const { return filter.memory_usage(); }
+
+    // Anagram class of the word, or -1 if no other word shares its letters
+    // (always -1 without the anagram index)
+    int anagram_class(int word_id) const {
+        return anagram_class_of.empty() ? -1 : anagram_class_of[word_id];
+    }
+    bool has_anagram_index() const { return !anagram_class_of.empty(); }
+
+    // Word ids of the class members, ascending
+    const int* anagram_members_begin(int anagram_class) const {
+        return &anagram_members[anagram_class_offset[anagram_class]];
+    }
+    const int* anagram_members_end(int anagram_class) const {
+        return &anagram_members[0] + anagram_class_offset[anagram_class + 1];
+    }
+
+    // Letters used at each position by words of the given length, or nullptr
+    // if no word has that length
+    const LetterMask* letters_at(size_t length) const {
+        if (length >= letter_mask_offset.size() || letter_mask_offset[length] == NO_LETTER_MASKS) {
+            return nullptr;
+        }
+        return &letter_masks[letter_mask_offset[length]];
+    }
+
+private:
+    static constexpr size_t NO_LETTER_MASKS = static_cast<size_t>(-1);
+
+    enum class Storage { Strings, FrontCoded, Mapped };
+
+    Storage storage = Storage::Strings;
+    size_t num_words = 0;
+    std::vector<std::string> dictionary;     // Storage::Strings
+    FrontCodedDictionary front_coded;        // Storage::FrontCoded
+    BlockedBloomFilter filter;
+    std::vector<int> original_order; // Maps sorted index back to original dictionary order
+    const int *order = nullptr;      // original_order, or its mapped image
+    size_t longest_word = 0;
+
+    // Storage::Mapped: word i is image_chars[image_offsets[i], image_offsets[i + 1]).
+    // The directory holds the first word starting on each page of the
+    // characters, so a lookup touches only the pages its binary search ends in.
+    MappedFile mapped_chars;
+    MappedFile mapped_offsets;
+    MappedFile mapped_order;
+    const char *image_chars = nullptr;
+    const uint64_t *image_offsets = nullptr;
+    std::vector<int> page_first_id;
+    std::vector<std::string> page_first_word;
+    size_t memory_ceiling = 0;
+    size_t word_pages = 0;
+    size_t lookup_pages = 0;
+    mutable std::atomic<int> live_searches{0};
+
+    // The masks for words of length L are letter_masks[letter_mask_offset[L] + pos]
+    std::vector<size_t> letter_mask_offset;
+    std::vector<LetterMask> letter_masks;
+
+    // Anagram classes with at least two members, stored as offsets into one
+    // member list; words alone in their class map to -1
+    std::vector<int> anagram_class_of;
+    std::vector<size_t> anagram_class_offset;
+    std::vector<int> anagram_members;
+
+    void build_in_memory(std::vector<std::string> words, const WordGraphOptions &options);
+    void build_out_of_core(DictionaryReader &reader);
+    void add_to_letter_masks(const std::string &word);
+    void build_anagram_index();
+    int find_mapped_word_id(const std::string &word) const;
+};
+
+// Every word a full queue or stack traversal from one begin word discovers,
+// with the parent it was discovered from. Parents are fixed at first discovery
+// and a search stops only once its end word is discovered, so the tree answers
+// any end word exactly as a fresh search with the same query would.
+class ParentTree {
+public:
+    QueryResult answer(int end_word_id) const;
+    size_t memory_usage() const;
+
+private:
+    friend class SearchContext;
+
+    int begin_word_id = -1;
+    std::vector<int> word_ids;                    // Sorted
+    std::vector<int> parents;                     // Aligned with word_ids
+    std::vector<ModificationInfo> modifications;  // Aligned with word_ids; empty for word output
+
+    // Index of the word in word_ids, or -1 if it was never discovered
+    int index_of(int word_id) const;
+};
+
+// Per-query search state over a shared WordGraph. A context serves one query
+// at a time; give each thread its own. Between queries only the words the
+// previous query discovered are reset, so reuse is cheap.
+class SearchContext {
+public:
+    explicit SearchContext(const WordGraph &graph);
+    ~SearchContext();
+
+    QueryResult search(const Query &query);
+
+    // Traverse everything reachable from the query's begin word, ignoring its
+    // end word. Queue and stack routing only.
+    void build_parent_tree(const Query &query, ParentTree &tree);
+
+    // Totals over every query this context has served
+    const SearchStats& stats() const { return search_stats; }
+
+private:
+    struct SearchEngines;
+
+    const WordGraph &graph;
+    bool file_backed;                        // Out of core: search arrays live in mapped files
+    LargeArray<int> parent_info;             // -2 undiscovered, -1 begin word
+    LargeArray<ModificationInfo> mod_info;   // Allocated on first modification output
+    LargeArray<int> path_cost;               // Allocated on first dijkstra search
+    std::vector<std::vector<int> > buckets;  // Dijkstra frontier
+    LargeArray<int> discovered;              // Every word discovered by the current query
+    size_t discovered_count = 0;
+    LargeArray<int> frontier;                // Queue or stack; every word is pushed at most once
+    size_t pages_until_check = 0;            // Out of core: pages left to touch before measuring memory
+    size_t memory_floor = 0;                 // Out of core: resident memory right after the last release
+    size_t bucket_bytes = 0;                 // Out of core: bucket heap charged so far
+    std::vector<int> neighbors;              // Neighbors of the word being expanded
+    std::string current_word;                // Word being expanded
+    std::string working_buffer;              // Candidate word being looked up
+    std::vector<std::pair<size_t, int> > swap_partners;  // Swap position and anagram reached
+    SearchStats search_stats;
+
+    void reset();
+    void touch_pages(size_t pages);
+    void check_memory();
+    void release_pages();
+    void charge_buckets();
+    const SearchEngines& prepare(const Query &query);
+    int lookup_candidate(const std::string &candidate);
+    void discover(int word_id, int parent_id);
+    void sort_by_original_order(std::vector<int> &word_ids) const;
+    void reconstruct_path(int begin_word_id, int end_word_id, std::vector<int> &path);
+
+    template <unsigned Modes, typename Visitor>
+    bool for_each_neighbor(int current_word_id, Visitor visit);
+    template <unsigned Modes>
+    bool generate_neighbors(int current_word_id, int end_word_id);
+    template <unsigned Modes>
+    bool search_bfs(int begin_word_id, int end_word_id);
+    template <unsigned Modes>
+    bool search_dfs(int begin_word_id, int end_word_id);
+    template <unsigned Modes>
+    bool search_dijkstra(int begin_word_id, int end_word_id, const int *costs, int &total_cost);
+
+    template <size_t... ModeSets>
+    static const SearchEngines& select_search_engines(unsigned modes, std::index_sequence<ModeSets...>);
+};
+
+#endif // WORD_GRAPH_H